@@ -0,0 +1,577 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "MidIPS.hpp"
+#include "LibMidIPS.hpp"
+#include "BigEdian.hpp"
+#include "Scan.hpp"
+
+//! @brief Bytes of a pair generated at once, every edit stays within its block.
+#define GENERATE_BLOCK_SIZE (1 << 20)
+
+//! @brief Bytes in a megabyte, as in the reported MB/s.
+#define BYTES_PER_MB 1000000.0
+
+//! @brief The scenarios run when --scenarios isn't given.
+static const char *sScenarios[] = {"sparse", "dense", "rle", "shift"};
+
+//! @brief The operations timed on each pair, in the order they run.
+static const char *sOperations[] = {"create", "apply", "validate"};
+
+//! @brief A splitmix64 generator, so the same seed always gives the same pair.
+struct BenchRandom
+{
+    u64 state;
+
+    u64 next()
+    {
+        u64 retVal = (state += 0x9E3779B97F4A7C15ULL);
+
+        retVal = (retVal ^ (retVal >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        retVal = (retVal ^ (retVal >> 27)) * 0x94D049BB133111EBULL;
+
+        return retVal ^ (retVal >> 31);
+    }
+
+    size_t below(const size_t bound)
+    {
+        return next() % bound;
+    }
+};
+
+//! @brief What a single timed run sends back from its child process.
+struct BenchSample
+{
+    MidIPS::Status status;
+    double seconds;
+    size_t hunkCount;
+    size_t outputSize;
+    long peakRSS;
+};
+
+//! @brief Everything the command line sets.
+struct BenchSettings
+{
+    std::vector<size_t> sizes;
+    std::vector<std::string> scenarios;
+    size_t runs;
+    u64 seed;
+    std::string directory;
+    bool isKept;
+    MidIPS::Options options;
+};
+
+/**
+ * @param argc
+ * @param argv
+ * @param name
+ *
+ * @brief Gets the value of a "name=value" argument.
+ *
+ * @returns The value, or an empty string
+ * if the argument isn't there.
+ */
+static std::string getOption(int argc, char **argv, const std::string &name)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strncmp(argv[i], name.c_str(), name.length()) == 0 && argv[i][name.length()] == '=')
+            return argv[i] + name.length() + 1;
+    }
+
+    return {""};
+}
+
+/**
+ * @param list
+ *
+ * @brief Splits a comma separated list.
+ */
+static std::vector<std::string> splitList(const std::string &list)
+{
+    std::vector<std::string> retVal;
+    size_t start = 0;
+
+    while (start <= list.length())
+    {
+        const size_t end = std::min(list.find(',', start), list.length());
+
+        if (end > start)
+            retVal.push_back(list.substr(start, end - start));
+
+        start = end + 1;
+    }
+
+    return retVal;
+}
+
+/**
+ * @param text
+ *
+ * @brief Parses a size such as "512K", "16M" or
+ * "4G", the suffixes being powers of 1024.
+ */
+static size_t parseSize(const std::string &text)
+{
+    char *end = nullptr;
+    size_t retVal = std::strtoull(text.c_str(), &end, 10);
+
+    if (end == text.c_str())
+        FATAL_ERROR("Invalid size provided: " << text);
+
+    switch (*end)
+    {
+    case 'G':
+        retVal <<= 10;
+        // fall through
+    case 'M':
+        retVal <<= 10;
+        // fall through
+    case 'K':
+        retVal <<= 10;
+        end++;
+        break;
+    }
+
+    if (*end != '\0' || retVal == 0)
+        FATAL_ERROR("Invalid size provided: " << text);
+
+    return retVal;
+}
+
+/**
+ * @param seed
+ * @param scenario
+ * @param block
+ *
+ * @brief Makes the generator of one block, so every
+ * block only depends on the seed, the scenario and
+ * its own index, whatever the size of the pair.
+ */
+static BenchRandom randomFor(const u64 seed, const std::string &scenario, const size_t block)
+{
+    BenchRandom retVal = {seed};
+
+    for (size_t i = 0, max = scenario.length(); i < max; i++)
+        retVal.state = retVal.state * 31 + scenario[i];
+
+    retVal.state ^= block * 0xD1B54A32D192ED03ULL;
+    retVal.next();
+
+    return retVal;
+}
+
+/**
+ * @param random
+ * @param block
+ * @param offset
+ * @param length
+ *
+ * @brief Overwrites length bytes of block with
+ * different ones, so that every one of them is an edit.
+ */
+static void edit(BenchRandom *random, std::vector<u8> *block, const size_t offset, const size_t length)
+{
+    for (size_t i = offset, end = std::min(offset + length, block->size()); i < end; i++)
+        (*block)[i] ^= 1 + random->below(U8_MAX);
+}
+
+/**
+ * @param random
+ * @param block
+ * @param offset
+ * @param length
+ *
+ * @brief Fills length bytes of block with the
+ * same byte, which must have been different for
+ * at least some of them.
+ */
+static void fillRun(BenchRandom *random, std::vector<u8> *block, const size_t offset, const size_t length)
+{
+    std::fill(block->begin() + offset, block->begin() + std::min(offset + length, block->size()), static_cast<u8>(random->next()));
+}
+
+/**
+ * @param scenario
+ * @param random
+ * @param target
+ *
+ * @brief Turns a copy of a source block into
+ * its target block, as the scenario says.
+ *
+ * @details "sparse" has a few tiny edits per block,
+ * "dense" has one every 4 KiB, covering about an eighth
+ * of the bytes, and "rle" has runs of a single byte.
+ * "shift" is handled by the caller.
+ */
+static void mutate(const std::string &scenario, BenchRandom *random, std::vector<u8> *target)
+{
+    const size_t size = target->size();
+
+    if (scenario == "sparse")
+    {
+        for (size_t i = 0; i < 4; i++)
+            edit(random, target, random->below(size), 1 + random->below(16));
+    }
+    else if (scenario == "dense")
+    {
+        for (size_t start = 0; start < size; start += 4096)
+            edit(random, target, start + random->below(std::min(size - start, static_cast<size_t>(4096))), 64 + random->below(960));
+    }
+    else if (scenario == "rle")
+    {
+        for (size_t i = 0; i < 16; i++)
+            fillRun(random, target, random->below(size), 256 + random->below(3840));
+    }
+}
+
+/**
+ * @param settings
+ * @param scenario
+ * @param size
+ * @param sourceName
+ * @param targetName
+ *
+ * @brief Writes a source of size random bytes, and
+ * its target, block by block, so memory stays the
+ * same whatever the size.
+ *
+ * @details "shift" makes the target the source with
+ * one byte inserted in front, so every byte moves,
+ * the worst case for IPS, which can't copy data around.
+ */
+static void generatePair(const BenchSettings &settings, const std::string &scenario, const size_t size, const std::string &sourceName, const std::string &targetName)
+{
+    BigEdian source = {sourceName, std::ios::out | std::ios::binary};
+    BigEdian target = {targetName, std::ios::out | std::ios::binary};
+    std::vector<u8> sourceBlock;
+    std::vector<u8> targetBlock;
+    u8 carried = 0;
+
+    for (size_t start = 0, block = 0; start < size; start += GENERATE_BLOCK_SIZE, block++)
+    {
+        BenchRandom random = randomFor(settings.seed, "", block);
+
+        sourceBlock.resize(std::min(size - start, static_cast<size_t>(GENERATE_BLOCK_SIZE)));
+
+        // A whole u64 at a time, the block's tail taking what's left of the last one.
+        for (size_t i = 0, max = sourceBlock.size(); i < max; i += sizeof(u64))
+        {
+            const u64 bytes = random.next();
+
+            std::memcpy(sourceBlock.data() + i, &bytes, std::min(max - i, sizeof(u64)));
+        }
+
+        source.writeBytes(sourceBlock.data(), sourceBlock.size());
+
+        if (scenario == "shift")
+        {
+            target.writeU8(carried);
+            target.writeBytes(sourceBlock.data(), sourceBlock.size() - 1);
+            carried = sourceBlock.back();
+            continue;
+        }
+
+        BenchRandom editRandom = randomFor(settings.seed, scenario, block);
+
+        targetBlock = sourceBlock;
+        mutate(scenario, &editRandom, &targetBlock);
+        target.writeBytes(targetBlock.data(), targetBlock.size());
+    }
+
+    if (scenario == "shift")
+        target.writeU8(carried);
+
+    source.flush();
+    target.flush();
+
+    if (!source.good())
+        FATAL_ERROR(source.error());
+    if (!target.good())
+        FATAL_ERROR(target.error());
+}
+
+/**
+ * @param operation
+ *
+ * @brief Times operation in a child process of its own.
+ *
+ * @details That way, the peak RSS the kernel reports for
+ * the child is the operation's alone, and nothing one run
+ * allocates or caches is left for the next one.
+ */
+static BenchSample measure(const std::function<MidIPS::Status(MidIPS::Report *)> &operation)
+{
+    BenchSample retVal = {MidIPS::Status::WriteFailed, 0, 0, 0, 0};
+    struct rusage usage;
+    int fds[2];
+    int childStatus = 0;
+
+    if (pipe(fds) != 0)
+        FATAL_ERROR("Couldn't create a pipe.");
+
+    const pid_t child = fork();
+
+    if (child < 0)
+        FATAL_ERROR("Couldn't fork.");
+
+    if (child == 0)
+    {
+        MidIPS::Report report;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        retVal.status = operation(&report);
+        retVal.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        retVal.hunkCount = report.hunkCount;
+        retVal.outputSize = report.outputSize;
+
+        _exit(write(fds[1], &retVal, sizeof(retVal)) == sizeof(retVal) ? 0 : 1);
+    }
+
+    close(fds[1]);
+
+    if (read(fds[0], &retVal, sizeof(retVal)) != sizeof(retVal))
+        retVal.status = MidIPS::Status::ReadFailed;
+
+    close(fds[0]);
+    wait4(child, &childStatus, 0, &usage);
+
+    // In KiB on Linux.
+    retVal.peakRSS = usage.ru_maxrss;
+
+    return retVal;
+}
+
+/**
+ * @param fileName1
+ * @param fileName2
+ *
+ * @brief Compares both files byte by byte.
+ *
+ * @details Block by block, so memory doesn't
+ * depend on the files' size.
+ *
+ * @returns true if they're the same.
+ */
+static bool isSameFile(const std::string &fileName1, const std::string &fileName2)
+{
+    BigEdian file1 = {fileName1, std::ios::in | std::ios::binary};
+    BigEdian file2 = {fileName2, std::ios::in | std::ios::binary};
+
+    if (!file1.good() || !file2.good() || file1.size() != file2.size())
+        return false;
+
+    for (size_t start = 0, size = file1.size(); start < size; start += GENERATE_BLOCK_SIZE)
+    {
+        const size_t length = std::min(size - start, static_cast<size_t>(GENERATE_BLOCK_SIZE));
+        const u8 *bytes1 = file1.readBytes(length);
+        const u8 *bytes2 = file2.readBytes(length);
+
+        if (bytes1 == nullptr || bytes2 == nullptr || std::memcmp(bytes1, bytes2, length) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @param settings
+ * @param scenario
+ * @param size
+ * @param operation
+ * @param sourceName
+ * @param targetName
+ * @param patchName
+ * @param workName
+ *
+ * @brief Runs operation settings.runs times, and
+ * prints a JSON object describing the runs.
+ *
+ * @details Throughput is counted on the largest of both
+ * files, whatever the operation actually reads. Every
+ * application starts from a fresh copy of the source,
+ * and is then compared against the target, both made
+ * outside of the timed part.
+ */
+static bool runOperation(const BenchSettings &settings, const std::string &scenario, const size_t size, const std::string &operation, const std::string &sourceName, const std::string &targetName, const std::string &patchName, const std::string &workName)
+{
+    const MidIPS::Options &options = settings.options;
+    const size_t targetSize = scenario == "shift" ? size + 1 : size;
+    std::vector<double> seconds;
+    size_t hunkCount = 0;
+    long peakRSS = 0;
+    bool isOk = true;
+
+    for (size_t run = 0; run < settings.runs; run++)
+    {
+        BenchSample sample;
+
+        if (operation == "create")
+        {
+            sample = measure([&](MidIPS::Report *report)
+                             { return MidIPS::createFile(sourceName, targetName, patchName, options, report); });
+        }
+        else if (operation == "apply")
+        {
+            if (BigEdian::clone(sourceName, workName) != MidIPS::Status::Ok)
+                FATAL_ERROR("Couldn't copy " << sourceName << " to " << workName << ".");
+
+            sample = measure([&](MidIPS::Report *report)
+                             { return MidIPS::applyFile(patchName, workName, "", options, report); });
+
+            if (!isSameFile(workName, targetName))
+                isOk = false;
+        }
+        else
+        {
+            sample = measure([&](MidIPS::Report *report)
+                             { return MidIPS::validateFile(patchName, sourceName, options, report); });
+        }
+
+        // Only the IPS paths report the resulting size.
+        if (sample.status != MidIPS::Status::Ok || (operation != "create" && sample.outputSize != 0 && sample.outputSize != targetSize))
+            isOk = false;
+
+        seconds.push_back(sample.seconds);
+        hunkCount = sample.hunkCount;
+        peakRSS = std::max(peakRSS, sample.peakRSS);
+    }
+
+    std::sort(seconds.begin(), seconds.end());
+
+    const double median = seconds[seconds.size() / 2];
+    const double megabytes = std::max(size, targetSize) / BYTES_PER_MB;
+    BigEdian patch = {patchName, std::ios::in | std::ios::binary};
+
+    std::printf("    {\"scenario\": \"%s\", \"size\": %lu, \"operation\": \"%s\", \"ok\": %s, \"runs\": %lu, "
+                "\"seconds\": {\"min\": %.6f, \"median\": %.6f, \"max\": %.6f}, \"mbPerSecond\": %.2f, "
+                "\"hunks\": %lu, \"hunksPerSecond\": %.1f, \"patchSize\": %lu, \"peakRSSKiB\": %ld}",
+                scenario.c_str(), size, operation.c_str(), isOk ? "true" : "false", settings.runs,
+                seconds.front(), median, seconds.back(), median > 0 ? megabytes / median : 0.0,
+                hunkCount, median > 0 ? hunkCount / median : 0.0, patch.size(), peakRSS);
+
+    return isOk;
+}
+
+/**
+ * @param argc
+ * @param argv
+ *
+ * @brief Reads the settings from the command line.
+ */
+static BenchSettings parseSettings(int argc, char **argv)
+{
+    BenchSettings retVal;
+    const std::string sizes = getOption(argc, argv, "--sizes");
+    const std::string scenarios = getOption(argc, argv, "--scenarios");
+    const std::string runs = getOption(argc, argv, "--runs");
+    const std::string seed = getOption(argc, argv, "--seed");
+    const std::string threads = getOption(argc, argv, "-j");
+    const std::string format = getOption(argc, argv, "-f");
+
+    std::vector<std::string> sizeList = splitList(sizes.empty() ? "1M,16M,256M" : sizes);
+
+    for (size_t i = 0, max = sizeList.size(); i < max; i++)
+        retVal.sizes.push_back(parseSize(sizeList[i]));
+
+    retVal.scenarios = scenarios.empty() ? std::vector<std::string>(sScenarios, sScenarios + 4) : splitList(scenarios);
+    retVal.runs = runs.empty() ? 3 : std::strtoul(runs.c_str(), nullptr, 10);
+    retVal.seed = seed.empty() ? 1 : std::strtoull(seed.c_str(), nullptr, 10);
+    retVal.directory = getOption(argc, argv, "--dir");
+    retVal.isKept = false;
+    retVal.options.threadCount = threads.empty() ? 1 : std::strtoul(threads.c_str(), nullptr, 10);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--keep") == 0)
+            retVal.isKept = true;
+    }
+
+    if (retVal.directory.empty())
+        retVal.directory = "/tmp";
+    if (retVal.runs == 0)
+        FATAL_ERROR("Invalid run count provided.");
+    if (format == "bps")
+        retVal.options.format = MidIPS::Format::BPS;
+    else if (format == "ups")
+        retVal.options.format = MidIPS::Format::UPS;
+    else if (!format.empty() && format != "ips")
+        FATAL_ERROR("Invalid format provided, expected ips, bps or ups.");
+
+    for (size_t i = 0, max = retVal.scenarios.size(); i < max; i++)
+    {
+        if (std::find(sScenarios, sScenarios + 4, retVal.scenarios[i]) == sScenarios + 4)
+            FATAL_ERROR("Unknown scenario provided: " << retVal.scenarios[i]);
+    }
+
+    return retVal;
+}
+
+/**
+ * @param argc
+ * @param argv
+ *
+ * @brief Generates every scenario at every size, times
+ * creating, applying and validating their patches, and
+ * prints the results as JSON on stdout.
+ *
+ * @details Progress goes to stderr, so stdout can be
+ * piped straight into whatever compares the results.
+ * The generated files are removed unless --keep is given.
+ *
+ * @returns 1 if any run failed.
+ */
+int main(int argc, char **argv)
+{
+    const BenchSettings settings = parseSettings(argc, argv);
+    const char *format = settings.options.format == MidIPS::Format::BPS ? "bps" : settings.options.format == MidIPS::Format::UPS ? "ups" : "ips";
+    bool isFirst = true;
+    bool isOk = true;
+
+    std::printf("{\n  \"format\": \"%s\", \"scan\": \"%s\", \"seed\": %llu, \"threads\": %lu, \"runs\": %lu,\n  \"results\": [", format, scanVariant(), settings.seed, settings.options.threadCount, settings.runs);
+
+    for (size_t i = 0, max = settings.scenarios.size(); i < max; i++)
+    {
+        for (size_t j = 0, sizeCount = settings.sizes.size(); j < sizeCount; j++)
+        {
+            const std::string &scenario = settings.scenarios[i];
+            const std::string prefix = settings.directory + "/midips-bench-" + scenario + "-" + std::to_string(settings.sizes[j]);
+            const std::string sourceName = prefix + ".source";
+            const std::string targetName = prefix + ".target";
+            const std::string patchName = prefix + "." + format;
+            const std::string workName = prefix + ".work";
+
+            std::fprintf(stderr, "%s, %lu bytes...\n", scenario.c_str(), settings.sizes[j]);
+            generatePair(settings, scenario, settings.sizes[j], sourceName, targetName);
+
+            for (const char *operation : sOperations)
+            {
+                std::printf("%s\n", isFirst ? "" : ",");
+                isOk = runOperation(settings, scenario, settings.sizes[j], operation, sourceName, targetName, patchName, workName) && isOk;
+                isFirst = false;
+            }
+
+            std::fflush(stdout);
+
+            if (!settings.isKept)
+            {
+                std::remove(sourceName.c_str());
+                std::remove(targetName.c_str());
+                std::remove(patchName.c_str());
+                std::remove(workName.c_str());
+            }
+        }
+    }
+
+    std::printf("\n  ]\n}\n");
+
+    return isOk ? 0 : 1;
+}
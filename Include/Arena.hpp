@@ -0,0 +1,32 @@
+#ifndef GUARD_ARENA_HPP
+#define GUARD_ARENA_HPP
+
+#include <vector>
+#include "Types.hpp"
+
+class Arena
+{
+private:
+    struct Block
+    {
+        u8 *data;
+        size_t size;
+    };
+
+    std::vector<Block> m_blocks;
+    size_t m_blockSize;
+    size_t m_current;
+    size_t m_used;
+
+public:
+    Arena(const size_t blockSize = (1 << 20));
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena();
+
+    u8 *allocate(const size_t length);
+    const u8 *store(const u8 *bytes, const size_t length);
+    void reset();
+};
+
+#endif // GUARD_ARENA_HPP
@@ -0,0 +1,17 @@
+#ifndef GUARD_BPS_HPP
+#define GUARD_BPS_HPP
+
+#include <string>
+#include <vector>
+#include "Types.hpp"
+#include "Status.hpp"
+#include "BigEdian.hpp"
+
+//! @brief Size of the header, "BPS1".
+#define BPS_MAGIC_LENGTH 4
+
+bool isBPS(const u8 *patch, const size_t patchSize);
+MidIPS::Status applyBPS(const u8 *patch, const size_t patchSize, const u8 *source, const size_t sourceSize, std::vector<u8> *target, size_t *actionCount, std::string *error);
+size_t createBPS(const u8 *source, const size_t sourceSize, const u8 *target, const size_t targetSize, BigEdian *output);
+
+#endif // GUARD_BPS_HPP
@@ -1,35 +1,78 @@
 #ifndef GUARD_BIG_EDIAN_HPP
 #define GUARD_BIG_EDIAN_HPP
 
-#include <fstream>
+#include <ios>
 #include <string>
+#include <vector>
 #include "Types.hpp"
+#include "Status.hpp"
+
+struct iovec;
 
 class BigEdian
 {
 private:
-    std::fstream m_fileBuffer;
+    int m_fd;
     std::string m_fileName;
+    std::vector<u8> *m_memory;
+    MidIPS::Status m_status;
     size_t m_size;
+    size_t m_position;
+    u8 *m_mapping;
+    bool m_ownsMapping;
+    u8 *m_readBuffer;
+    size_t m_readCapacity;
+    size_t m_readStart;
+    size_t m_readLength;
+    u8 *m_writeBuffer;
+    size_t m_writeStart;
+    size_t m_writeLength;
+
+    void initialize(const std::string &fileName, const size_t size);
+    void fail(const MidIPS::Status status);
+    void tryMapping();
+    size_t bufferedLength() const;
+    void fillReadBuffer(const size_t minimum);
+    void invalidateReadBuffer(const size_t offset, const size_t length);
+    bool writeChunks(struct iovec *chunks, int count, size_t offset) const;
+    bool writeRepeated(size_t offset, const u8 *block, const size_t blockSize, size_t count) const;
 
 public:
     BigEdian(const std::string &fileName, const std::ios_base::openmode &mode);
+    BigEdian(const u8 *memory, const size_t size);
+    BigEdian(std::vector<u8> *memory);
+    BigEdian(const BigEdian &) = delete;
+    BigEdian &operator=(const BigEdian &) = delete;
     ~BigEdian();
     u8 readU8();
-    u8 *readBytes(const size_t &length);
+    const u8 *readBytes(const size_t &length);
     u16 readU16();
     u32 readU24();
     u32 readU32();
+    u64 readU64();
     void writeU8(const u8 &toWrite);
     void writeBytes(const u8 *toWrite, const size_t &length);
     void writeU16(const u16 &toWrite);
     void writeU24(const u32 &toWrite);
     void writeU32(const u32 &toWrite);
+    void writeU64(const u64 &toWrite);
+    bool writeAt(const size_t offset, const u8 *toWrite, const size_t length) const;
+    void fill(const u8 &value, const size_t &count);
+    bool fillAt(const size_t offset, const u8 &value, const size_t count) const;
+    void resize(const size_t size);
     void flush();
+    void reload();
     void seek(const size_t offset);
     size_t tell();
     size_t size();
     bool isEnd();
+    bool isMapped() const;
+    const u8 *data() const;
+    bool good() const;
+    MidIPS::Status status() const;
+    std::string error() const;
+
+    static MidIPS::Status clone(const std::string &sourceName, const std::string &destinationName);
 };
 
-#endif // GUARD_BIG_EDIAN_HPP
\ No newline at end of file
+#endif // GUARD_BIG_EDIAN_HPP
@@ -0,0 +1,36 @@
+#ifndef GUARD_BLOCK_INDEX_HPP
+#define GUARD_BLOCK_INDEX_HPP
+
+#include <string>
+#include "Types.hpp"
+#include "Status.hpp"
+#include "BigEdian.hpp"
+
+class BlockIndex
+{
+private:
+    BigEdian m_file;
+    MidIPS::Status m_status;
+    u32 m_blockSize;
+    u64 m_sourceSize;
+    u64 m_modifiedTime;
+    size_t m_blockCount;
+    const u8 *m_hashes;
+
+public:
+    BlockIndex(const std::string &indexName);
+    BlockIndex(const BlockIndex &) = delete;
+    BlockIndex &operator=(const BlockIndex &) = delete;
+
+    bool good() const;
+    MidIPS::Status status() const;
+    std::string error() const;
+    bool matches(const std::string &sourceName) const;
+    u32 blockSize() const;
+    size_t blockCount() const;
+    const u8 *hash(const size_t block) const;
+
+    static MidIPS::Status build(const std::string &sourceName, const std::string &indexName);
+};
+
+#endif // GUARD_BLOCK_INDEX_HPP
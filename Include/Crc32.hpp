@@ -0,0 +1,8 @@
+#ifndef GUARD_CRC32_HPP
+#define GUARD_CRC32_HPP
+
+#include "Types.hpp"
+
+u32 crc32(const u8 *bytes, const size_t length, const u32 crc = 0);
+
+#endif // GUARD_CRC32_HPP
@@ -2,36 +2,41 @@
 #define GUARD_HUNK_HPP
 
 #include <iostream>
-#include <vector>
 #include "Types.hpp"
+#include "Arena.hpp"
 #include "BigEdian.hpp"
 
 class Hunk
 {
 private:
-    u32 m_offset;
+    size_t m_offset;
     u16 m_length;
     u16 m_count;
-    std::vector<u8> *m_bytes;
+    const u8 *m_bytes;
+
+    static Hunk fromBytes(const size_t offset, const u8 *bytes, const u16 size);
+    static Hunk fromMappedDiff(BigEdian *source, BigEdian *target);
 
 public:
-    Hunk(const u32 offset, const u16 length, const u16 count, std::vector<u8> *bytes);
-    Hunk(Hunk &hunk);
-    Hunk(Hunk &&hunk);
-    ~Hunk();
-    Hunk &operator=(const Hunk &source);
+    Hunk(const size_t offset, const u16 length, const u16 count, const u8 *bytes);
 
-    u32 offset() const;
+    size_t offset() const;
     u16 length() const;
     u16 count() const;
-    std::vector<u8> *bytes() const;
+    const u8 *bytes() const;
+    size_t size() const;
+    bool isEmpty() const;
+    Hunk slice(const size_t start, const size_t end) const;
 
-    void write(BigEdian *destination, bool allowAboveU24);
-    void asIPS(BigEdian *destination, bool allowAboveU24);
-    static Hunk fromIPS(BigEdian *ipsParser);
-    static Hunk fromDiff(BigEdian *source, BigEdian *target);
+    void asIPS(BigEdian *destination, const bool isIPS32) const;
+    static Hunk fromIPS(BigEdian *ipsParser, const bool isIPS32, Arena *arena = nullptr);
+    static Hunk skipIPS(BigEdian *ipsParser, const bool isIPS32);
+    static bool endsIPS(BigEdian *ipsParser, const bool isIPS32, size_t *truncateSize);
+    static size_t endMarker(const bool isIPS32);
+    static size_t offsetLimit(const bool isIPS32);
+    static Hunk fromDiff(BigEdian *source, BigEdian *target, Arena *arena);
 };
 
-std::ostream &operator<<(std::ostream &out, Hunk &hunk);
+std::ostream &operator<<(std::ostream &out, const Hunk &hunk);
 
-#endif // GUARD_HUNK_HPP
\ No newline at end of file
+#endif // GUARD_HUNK_HPP
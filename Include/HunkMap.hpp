@@ -0,0 +1,20 @@
+#ifndef GUARD_HUNK_MAP_HPP
+#define GUARD_HUNK_MAP_HPP
+
+#include <map>
+#include "Types.hpp"
+#include "Hunk.hpp"
+
+class HunkMap
+{
+private:
+    std::map<size_t, Hunk> m_hunks;
+
+public:
+    void write(const Hunk &hunk);
+    void truncate(const size_t size);
+    bool byteAt(const size_t offset, u8 *byte) const;
+    const std::map<size_t, Hunk> &hunks() const;
+};
+
+#endif // GUARD_HUNK_MAP_HPP
@@ -0,0 +1,33 @@
+#ifndef GUARD_HUNK_PLANNER_HPP
+#define GUARD_HUNK_PLANNER_HPP
+
+#include <functional>
+#include <vector>
+#include "Types.hpp"
+#include "Hunk.hpp"
+
+class HunkPlanner
+{
+private:
+    std::function<void(size_t offset, size_t length, u8 *bytes)> m_readTarget;
+    std::function<void(const Hunk &)> m_onPlanned;
+    std::vector<u8> m_pending;
+    size_t m_start;
+    size_t m_endMarker;
+    size_t m_headerSize;
+
+    void appendGap(const size_t offset, const size_t length);
+    void emitLiteral(const size_t start, const size_t end);
+    void emitRLE(const size_t start, const size_t end);
+    void plan();
+
+public:
+    HunkPlanner(const std::function<void(size_t offset, size_t length, u8 *bytes)> &readTarget, const std::function<void(const Hunk &)> &onPlanned, const bool isIPS32);
+    HunkPlanner(const HunkPlanner &) = delete;
+    HunkPlanner &operator=(const HunkPlanner &) = delete;
+
+    void push(const Hunk &diffHunk);
+    void finish();
+};
+
+#endif // GUARD_HUNK_PLANNER_HPP
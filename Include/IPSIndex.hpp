@@ -0,0 +1,54 @@
+#ifndef GUARD_IPS_INDEX_HPP
+#define GUARD_IPS_INDEX_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "Types.hpp"
+#include "Arena.hpp"
+#include "BigEdian.hpp"
+#include "Hunk.hpp"
+
+struct IPSSummary
+{
+    size_t hunkCount;
+    size_t byteCount;
+    size_t outputSize;
+    std::string error;
+};
+
+struct IPSResolution
+{
+    std::vector<Hunk> writes;
+    size_t resolvedSize = 0;
+    std::string error;
+};
+
+class IPSIndex
+{
+private:
+    std::vector<size_t> m_offsets;
+    std::vector<u16> m_lengths;
+    std::vector<u16> m_counts;
+    std::vector<const u8 *> m_payloads;
+    size_t m_truncateSize;
+    Arena m_arena;
+
+public:
+    IPSIndex();
+    IPSIndex(const IPSIndex &) = delete;
+    IPSIndex &operator=(const IPSIndex &) = delete;
+
+    MidIPS::Status parse(BigEdian *ipsParser, const bool isIPS32);
+    size_t hunkCount() const;
+    Hunk hunk(const size_t index) const;
+    bool hasTruncate() const;
+    size_t truncateSize() const;
+    MidIPS::Status resolve(const size_t destinationSize, IPSResolution *resolution) const;
+    size_t finalSize(const IPSResolution &resolution) const;
+    MidIPS::Status apply(BigEdian *destination, const size_t threadCount, IPSResolution *resolution, const std::function<void(const Hunk &original)> &onOverwrite = nullptr) const;
+
+    static MidIPS::Status validate(BigEdian *ipsParser, const size_t destinationSize, const bool isIPS32, IPSSummary *summary);
+};
+
+#endif // GUARD_IPS_INDEX_HPP
@@ -0,0 +1,82 @@
+#ifndef GUARD_LIB_MIDIPS_HPP
+#define GUARD_LIB_MIDIPS_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "Types.hpp"
+#include "Status.hpp"
+
+namespace MidIPS
+{
+    enum class Format
+    {
+        IPS,
+        BPS,
+        UPS,
+    };
+
+    enum class Hash
+    {
+        None,
+        CRC32,
+        XXH64,
+    };
+
+    struct Checksum
+    {
+        Hash hash = Hash::None;
+        u64 value = 0;
+    };
+
+    struct Options
+    {
+        size_t threadCount = 1;
+        std::string indexName;
+        std::string undoName;
+        Format format = Format::IPS;
+        Checksum sourceChecksum;
+        Checksum outputChecksum;
+        std::function<void(size_t offset, size_t size)> onHunk;
+    };
+
+    struct Report
+    {
+        size_t hunkCount = 0;
+        size_t byteCount = 0;
+        size_t outputSize = 0;
+        std::string detail;
+    };
+
+    struct ApplyJob
+    {
+        std::string patchName;
+        std::string subjectName;
+        std::string outputName;
+        Status status = Status::Ok;
+        Report report;
+    };
+
+    struct CreateJob
+    {
+        std::string targetName;
+        std::string patchName;
+        Status status = Status::Ok;
+        Report report;
+    };
+
+    Status apply(const u8 *source, const size_t sourceSize, const u8 *patch, const size_t patchSize, std::vector<u8> &output, const Options &options = Options(), Report *report = nullptr);
+    Status create(const u8 *source, const size_t sourceSize, const u8 *target, const size_t targetSize, std::vector<u8> &patch, const Options &options = Options(), Report *report = nullptr);
+
+    Status validate(const u8 *patch, const size_t patchSize, const size_t targetSize, const Options &options = Options(), Report *report = nullptr);
+
+    Status applyFile(const std::string &patchName, const std::string &subjectName, const std::string &outputName, const Options &options = Options(), Report *report = nullptr);
+    Status createFile(const std::string &sourceName, const std::string &targetName, const std::string &patchName, const Options &options = Options(), Report *report = nullptr);
+    Status validateFile(const std::string &patchName, const std::string &subjectName, const Options &options = Options(), Report *report = nullptr);
+    Status applyBatch(std::vector<ApplyJob> &jobs, const Options &options = Options(), Report *report = nullptr);
+    Status createBatch(const std::string &sourceName, std::vector<CreateJob> &jobs, const Options &options = Options(), Report *report = nullptr);
+    Status squashFile(const std::vector<std::string> &patchNames, const std::string &baseName, const std::string &patchName, const Options &options = Options(), Report *report = nullptr);
+    Status indexFile(const std::string &sourceName, const std::string &indexName, Report *report = nullptr);
+}
+
+#endif // GUARD_LIB_MIDIPS_HPP
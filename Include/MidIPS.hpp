@@ -14,8 +14,6 @@
         std::cout << "INFO: " << msg << "\n"; \
     }
 
-#define BITS_IN(dataType) (sizeof(dataType) * 8)
-
 #ifndef NDEBUG
 #define DEBUG(msg)                \
     {                             \
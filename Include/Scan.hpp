@@ -0,0 +1,10 @@
+#ifndef GUARD_SCAN_HPP
+#define GUARD_SCAN_HPP
+
+#include "Types.hpp"
+
+size_t findMismatch(const u8 *bytes1, const u8 *bytes2, const size_t length);
+size_t findMatch(const u8 *bytes1, const u8 *bytes2, const size_t length);
+const char *scanVariant();
+
+#endif // GUARD_SCAN_HPP
@@ -0,0 +1,11 @@
+#ifndef GUARD_SHA256_HPP
+#define GUARD_SHA256_HPP
+
+#include "Types.hpp"
+
+//! @brief Size of a SHA-256 digest.
+#define SHA256_SIZE 32
+
+void sha256(const u8 *bytes, const size_t length, u8 *digest);
+
+#endif // GUARD_SHA256_HPP
@@ -0,0 +1,22 @@
+#ifndef GUARD_STATUS_HPP
+#define GUARD_STATUS_HPP
+
+namespace MidIPS
+{
+    enum class Status
+    {
+        Ok,
+        OpenFailed,
+        ReadFailed,
+        WriteFailed,
+        InvalidArgument,
+        InvalidHeader,
+        Truncated,
+        OffsetOutOfRange,
+        ChecksumMismatch,
+    };
+
+    const char *describe(const Status status);
+}
+
+#endif // GUARD_STATUS_HPP
@@ -0,0 +1,44 @@
+#ifndef GUARD_STREAM_READER_HPP
+#define GUARD_STREAM_READER_HPP
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "Types.hpp"
+#include "Status.hpp"
+
+class StreamReader
+{
+private:
+    int m_fd;
+    std::string m_fileName;
+    MidIPS::Status m_status;
+    u8 *m_buffers[2];
+    size_t m_lengths[2];
+    bool m_isFilled[2];
+    size_t m_next;
+    bool m_isHeld;
+    bool m_isEnded;
+    bool m_isStopping;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::thread m_reader;
+
+    void readAhead();
+
+public:
+    StreamReader(const std::string &fileName);
+    StreamReader(const StreamReader &) = delete;
+    StreamReader &operator=(const StreamReader &) = delete;
+    ~StreamReader();
+
+    const u8 *next(size_t *length);
+    bool good();
+    MidIPS::Status status();
+    std::string error();
+
+    static bool isStream(const std::string &fileName);
+};
+
+#endif // GUARD_STREAM_READER_HPP
@@ -1,17 +1,29 @@
 #ifndef GUARD_TYPES_HPP
 #define GUARD_TYPES_HPP
 
+#include <cstddef>
+
 using u8 = unsigned char;
 using u16 = unsigned short int;
 using u32 = unsigned int;
+using u64 = unsigned long long int;
 
 using i8 = signed char;
 using i16 = signed short int;
 using i32 = signed int;
+using i64 = signed long long int;
 
 #define U8_MAX 0xFF
 #define U16_MAX 0xFFFF
-#define U24_MAX 0xFFFFFFF
+#define U24_MAX 0xFFFFFF
 #define U32_MAX 0xFFFFFFFF
 
+//! @brief Offset of the last record of an IPS patch, translates literally to "EOF".
+#define IPS_END_MARKER 0x454F46
+
+//! @brief Offset of the last record of an IPS32 patch, translates literally to "EEOF".
+#define IPS32_END_MARKER 0x45454F46
+
+#define BITS_IN(dataType) (sizeof(dataType) * 8)
+
 #endif // GUARD_TYPES_HPP
\ No newline at end of file
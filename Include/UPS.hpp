@@ -0,0 +1,48 @@
+#ifndef GUARD_UPS_HPP
+#define GUARD_UPS_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "Types.hpp"
+#include "Status.hpp"
+#include "BigEdian.hpp"
+
+//! @brief Size of the header, "UPS1".
+#define UPS_MAGIC_LENGTH 4
+
+struct UPSSummary
+{
+    u64 targetSize = 0;
+    size_t recordCount = 0;
+    size_t byteCount = 0;
+    std::string error;
+};
+
+class UPSEncoder
+{
+private:
+    std::vector<u8> m_records;
+    u64 m_sourceSize;
+    u64 m_targetSize;
+    u64 m_recordEnd;
+    bool m_isInRecord;
+    size_t m_recordCount;
+    size_t m_byteCount;
+    u32 m_sourceCrc;
+    u32 m_targetCrc;
+
+    void pushChunk(const u8 *source, const size_t sourceLength, const u8 *target, const size_t targetLength);
+
+public:
+    UPSEncoder();
+    void push(const u8 *source, const size_t sourceLength, const u8 *target, const size_t targetLength);
+    void finish(BigEdian *output);
+    size_t recordCount() const;
+    size_t byteCount() const;
+};
+
+bool isUPS(const u8 *patch, const size_t patchSize);
+MidIPS::Status applyUPS(const u8 *patch, const size_t patchSize, const u8 *source, const size_t sourceSize, const std::function<void(size_t offset, const u8 *bytes, size_t length)> &onWrite, UPSSummary *summary);
+
+#endif // GUARD_UPS_HPP
@@ -0,0 +1,14 @@
+#ifndef GUARD_VAR_INT_HPP
+#define GUARD_VAR_INT_HPP
+
+#include "Types.hpp"
+
+//! @brief Most bytes a u64 takes once encoded.
+#define VAR_INT_MAX_LENGTH 10
+
+bool readNumber(const u8 *bytes, const size_t end, size_t *position, u64 *number);
+size_t encodeNumber(u64 number, u8 *bytes);
+u32 readLittleU32(const u8 *bytes);
+void encodeLittleU32(const u32 value, u8 *bytes);
+
+#endif // GUARD_VAR_INT_HPP
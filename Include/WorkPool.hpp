@@ -0,0 +1,32 @@
+#ifndef GUARD_WORK_POOL_HPP
+#define GUARD_WORK_POOL_HPP
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "Types.hpp"
+
+class WorkPool
+{
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> jobs;
+    };
+
+    size_t m_workerCount;
+    std::vector<Queue> m_queues;
+
+    bool take(const size_t worker, size_t *job);
+
+public:
+    WorkPool(const size_t workerCount);
+    WorkPool(const WorkPool &) = delete;
+    WorkPool &operator=(const WorkPool &) = delete;
+
+    void run(const size_t jobCount, const std::function<void(size_t job)> &work);
+};
+
+#endif // GUARD_WORK_POOL_HPP
@@ -0,0 +1,25 @@
+#ifndef GUARD_XXHASH64_HPP
+#define GUARD_XXHASH64_HPP
+
+#include "Types.hpp"
+
+//! @brief Bytes xxHash64 consumes at once, one lane of 8 per accumulator.
+#define XXHASH64_STRIPE_SIZE 32
+
+class XXHash64
+{
+private:
+    u64 m_lanes[4];
+    u8 m_stripe[XXHASH64_STRIPE_SIZE];
+    size_t m_stripeLength;
+    u64 m_totalLength;
+
+    void consume(const u8 *stripe);
+
+public:
+    XXHash64(const u64 seed = 0);
+    void update(const u8 *bytes, size_t length);
+    u64 digest() const;
+};
+
+#endif // GUARD_XXHASH64_HPP
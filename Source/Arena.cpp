@@ -0,0 +1,90 @@
+#include <cstring>
+#include "Arena.hpp"
+
+/**
+ * @param blockSize
+ *
+ * @brief Constructor, nothing gets
+ * allocated until it's actually needed.
+ */
+Arena::Arena(const size_t blockSize)
+{
+    m_blockSize = blockSize;
+    m_current = 0;
+    m_used = 0;
+}
+
+/**
+ * @brief Destructor, frees every block at once.
+ */
+Arena::~Arena()
+{
+    for (size_t i = 0, max = m_blocks.size(); i < max; i++)
+        delete[] m_blocks[i].data;
+}
+
+/**
+ * @param length
+ *
+ * @brief Hands out length bytes that live
+ * as long as the Arena, or until reset().
+ *
+ * @details Bytes are taken from the current
+ * block, and a new block only gets allocated
+ * when none of the kept ones has room left.
+ */
+u8 *Arena::allocate(const size_t length)
+{
+    while (m_current < m_blocks.size())
+    {
+        Block &block = m_blocks[m_current];
+
+        if (length <= block.size - m_used)
+        {
+            u8 *retVal = block.data + m_used;
+            m_used += length;
+
+            return retVal;
+        }
+
+        m_current++;
+        m_used = 0;
+    }
+
+    Block block;
+
+    block.size = length > m_blockSize ? length : m_blockSize;
+    block.data = new u8[block.size];
+
+    m_blocks.push_back(block);
+    m_current = m_blocks.size() - 1;
+    m_used = length;
+
+    return block.data;
+}
+
+/**
+ * @param bytes
+ * @param length
+ *
+ * @brief Copies length bytes into the Arena.
+ *
+ * @returns Where the copy lives.
+ */
+const u8 *Arena::store(const u8 *bytes, const size_t length)
+{
+    u8 *retVal = allocate(length);
+
+    std::memcpy(retVal, bytes, length);
+    return retVal;
+}
+
+/**
+ * @brief Forgets everything handed out so far,
+ * while keeping the blocks around for reuse.
+ */
+void Arena::reset()
+{
+    m_current = 0;
+    m_used = 0;
+}
@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include "BPS.hpp"
+#include "Crc32.hpp"
+#include "Scan.hpp"
+#include "VarInt.hpp"
+
+//! @brief Header of every BPS patch, translates literally to "BPS1".
+static const u8 sBPSMagic[] = {0x42, 0x50, 0x53, 0x31};
+
+//! @brief Size of the footer: the source's, the target's and the patch's CRC-32.
+#define BPS_FOOTER_SIZE 12
+
+//! @brief Size of the windows hashed to find copies, and so the shortest copy found.
+#define MATCH_WINDOW_SIZE 32
+
+//! @brief Shortest run worth a SourceRead rather than staying within a TargetRead.
+#define SOURCE_READ_MINIMUM 4
+
+//! @brief Multiplier of the rolling hash.
+#define ROLLING_PRIME 0x01000193
+
+//! @brief BPS actions, held by the 2 lowest bits of each action's header.
+enum Action
+{
+    SourceRead,
+    TargetRead,
+    SourceCopy,
+    TargetCopy,
+};
+
+//! @brief Where each hashed window of a file starts, one slot per hash, the first window kept.
+class WindowTable
+{
+private:
+    std::vector<u32> m_slots;
+    u32 m_shift;
+
+public:
+    /**
+     * @param size
+     *
+     * @brief Constructor, with about a slot
+     * per window of a size bytes file.
+     */
+    WindowTable(const size_t size)
+    {
+        size_t slotCount = 1;
+
+        m_shift = BITS_IN(u32);
+
+        while (slotCount < size / MATCH_WINDOW_SIZE)
+        {
+            slotCount <<= 1;
+            m_shift--;
+        }
+
+        m_slots.assign(slotCount, 0);
+    }
+
+    /**
+     * @param hash
+     * @param offset
+     *
+     * @brief Remembers the window at offset,
+     * unless its slot is already taken.
+     */
+    void insert(const u32 hash, const size_t offset)
+    {
+        u32 &slot = m_slots[slotOf(hash)];
+
+        if (slot == 0)
+            slot = offset / MATCH_WINDOW_SIZE + 1;
+    }
+
+    /**
+     * @param hash
+     * @param offset
+     *
+     * @brief Finds where a window with this hash was seen.
+     *
+     * @returns Whether one was, it may still differ.
+     */
+    bool find(const u32 hash, size_t *offset) const
+    {
+        const u32 slot = m_slots[slotOf(hash)];
+
+        *offset = (static_cast<size_t>(slot) - 1) * MATCH_WINDOW_SIZE;
+        return slot != 0;
+    }
+
+    /**
+     * @param hash
+     *
+     * @brief Spreads the hash over the slots.
+     */
+    size_t slotOf(const u32 hash) const
+    {
+        return m_shift == BITS_IN(u32) ? 0 : (hash * 0x9E3779B1U) >> m_shift;
+    }
+};
+
+//! @brief Writes the patch into a BigEdian, along with the CRC-32 of what was written.
+struct BPSWriter
+{
+    BigEdian *output;
+    u32 crc;
+};
+
+/**
+ * @param bytes
+ *
+ * @brief Hashes a whole window.
+ */
+static u32 hashWindow(const u8 *bytes)
+{
+    u32 hash = 0;
+
+    for (size_t i = 0; i < MATCH_WINDOW_SIZE; i++)
+        hash = hash * ROLLING_PRIME + bytes[i];
+
+    return hash;
+}
+
+/**
+ * @brief Returns ROLLING_PRIME to the power of
+ * MATCH_WINDOW_SIZE - 1, i.e. the weight of the
+ * first byte of a window.
+ */
+static u32 outgoingWeight()
+{
+    u32 weight = 1;
+
+    for (size_t i = 1; i < MATCH_WINDOW_SIZE; i++)
+        weight *= ROLLING_PRIME;
+
+    return weight;
+}
+
+/**
+ * @param writer
+ * @param bytes
+ * @param length
+ *
+ * @brief Writes bytes into the patch.
+ */
+static void writeBytes(BPSWriter *writer, const u8 *bytes, const size_t length)
+{
+    writer->output->writeBytes(bytes, length);
+    writer->crc = crc32(bytes, length, writer->crc);
+}
+
+/**
+ * @param writer
+ * @param number
+ *
+ * @brief Writes one of BPS' variable-length numbers.
+ */
+static void writeNumber(BPSWriter *writer, const u64 number)
+{
+    u8 bytes[VAR_INT_MAX_LENGTH];
+
+    writeBytes(writer, bytes, encodeNumber(number, bytes));
+}
+
+/**
+ * @param writer
+ * @param value
+ *
+ * @brief Writes a little-endian u32, BPS' checksums being so.
+ */
+static void writeLittleU32(BPSWriter *writer, const u32 value)
+{
+    u8 bytes[4];
+
+    encodeLittleU32(value, bytes);
+    writeBytes(writer, bytes, sizeof(bytes));
+}
+
+/**
+ * @param writer
+ * @param action
+ * @param length
+ *
+ * @brief Writes an action's header, length
+ * being how many bytes of the target it makes.
+ */
+static void writeAction(BPSWriter *writer, const Action action, const size_t length)
+{
+    writeNumber(writer, (static_cast<u64>(length - 1) << 2) | action);
+}
+
+/**
+ * @param writer
+ * @param from
+ * @param relative
+ *
+ * @brief Writes a copy's offset, relative to
+ * where the previous copy of its kind ended.
+ */
+static void writeRelative(BPSWriter *writer, const size_t from, size_t *relative)
+{
+    if (from >= *relative)
+        writeNumber(writer, static_cast<u64>(from - *relative) << 1);
+    else
+        writeNumber(writer, (static_cast<u64>(*relative - from) << 1) | 1);
+}
+
+/**
+ * @param patch
+ * @param patchSize
+ *
+ * @brief Tells BPS patches apart
+ * from IPS ones by their header.
+ */
+bool isBPS(const u8 *patch, const size_t patchSize)
+{
+    return patchSize >= BPS_MAGIC_LENGTH && std::memcmp(patch, sBPSMagic, BPS_MAGIC_LENGTH) == 0;
+}
+
+/**
+ * @param patch
+ * @param patchSize
+ * @param source
+ * @param sourceSize
+ * @param target
+ * @param actionCount
+ * @param error
+ *
+ * @brief Applies the BPS patch on source, into target.
+ *
+ * @details The patch is checked against its own CRC-32
+ * first, and the source against the one the patch was made
+ * from, then every action is bounds checked as it runs. The
+ * target is only meaningful if it returns Ok, which also
+ * means its CRC-32 is the expected one.
+ *
+ * @returns WriteFailed if the target size the patch claims
+ * can't be allocated.
+ */
+MidIPS::Status applyBPS(const u8 *patch, const size_t patchSize, const u8 *source, const size_t sourceSize, std::vector<u8> *target, size_t *actionCount, std::string *error)
+{
+    u64 expectedSourceSize = 0;
+    u64 targetSize = 0;
+    u64 metadataSize = 0;
+    size_t position = BPS_MAGIC_LENGTH;
+
+    if (!isBPS(patch, patchSize) || patchSize < BPS_MAGIC_LENGTH + BPS_FOOTER_SIZE)
+    {
+        *error = "The passed file is not a valid BPS patch.";
+        return MidIPS::Status::InvalidHeader;
+    }
+
+    const size_t end = patchSize - BPS_FOOTER_SIZE;
+
+    if (crc32(patch, patchSize - 4) != readLittleU32(patch + patchSize - 4))
+    {
+        *error = "The patch is corrupted, its checksum doesn't match.";
+        return MidIPS::Status::ChecksumMismatch;
+    }
+    if (!readNumber(patch, end, &position, &expectedSourceSize) || !readNumber(patch, end, &position, &targetSize) || !readNumber(patch, end, &position, &metadataSize) || metadataSize > end - position)
+    {
+        *error = "The patch's header is cut short.";
+        return MidIPS::Status::Truncated;
+    }
+    if (expectedSourceSize != sourceSize || crc32(source, sourceSize) != readLittleU32(patch + end))
+    {
+        *error = "The patch wasn't made for this file.";
+        return MidIPS::Status::ChecksumMismatch;
+    }
+
+    position += metadataSize;
+
+    // The size comes from the patch, so it may well be more than we can hold.
+    bool isAllocated = targetSize <= target->max_size();
+
+    try
+    {
+        if (isAllocated)
+            target->assign(targetSize, 0);
+    }
+    catch (const std::bad_alloc &)
+    {
+        isAllocated = false;
+    }
+
+    if (!isAllocated)
+    {
+        *error = "The patched file, of " + std::to_string(targetSize) + " bytes, doesn't fit in memory.";
+        return MidIPS::Status::WriteFailed;
+    }
+
+    *actionCount = 0;
+
+    u8 *output = target->data();
+    size_t outputOffset = 0;
+    size_t sourceRelative = 0;
+    size_t targetRelative = 0;
+
+    while (position < end)
+    {
+        u64 header = 0;
+        u64 relative = 0;
+
+        if (!readNumber(patch, end, &position, &header))
+            break;
+
+        const Action action = static_cast<Action>(header & 3);
+        const u64 length = (header >> 2) + 1;
+
+        if (length > targetSize - outputOffset)
+        {
+            *error = "An action writes past the end of the target.";
+            return MidIPS::Status::OffsetOutOfRange;
+        }
+        if ((action == SourceCopy || action == TargetCopy) && !readNumber(patch, end, &position, &relative))
+            break;
+
+        size_t &from = action == SourceCopy ? sourceRelative : targetRelative;
+        const size_t distance = relative >> 1;
+
+        if (action == SourceCopy || action == TargetCopy)
+        {
+            if (relative & 1 ? distance > from : distance > (action == SourceCopy ? sourceSize : outputOffset) - from)
+            {
+                *error = "A copy starts out of range.";
+                return MidIPS::Status::OffsetOutOfRange;
+            }
+
+            from = relative & 1 ? from - distance : from + distance;
+        }
+
+        switch (action)
+        {
+        case SourceRead:
+            if (outputOffset > sourceSize || length > sourceSize - outputOffset)
+            {
+                *error = "A read goes past the end of the source.";
+                return MidIPS::Status::OffsetOutOfRange;
+            }
+
+            std::memcpy(output + outputOffset, source + outputOffset, length);
+            break;
+        case TargetRead:
+            if (length > end - position)
+            {
+                *error = "The patch is cut short.";
+                return MidIPS::Status::Truncated;
+            }
+
+            std::memcpy(output + outputOffset, patch + position, length);
+            position += length;
+            break;
+        case SourceCopy:
+            if (length > sourceSize - from)
+            {
+                *error = "A copy goes past the end of the source.";
+                return MidIPS::Status::OffsetOutOfRange;
+            }
+
+            std::memcpy(output + outputOffset, source + from, length);
+            from += length;
+            break;
+        case TargetCopy:
+            if (from >= outputOffset)
+            {
+                *error = "A copy reads what isn't written yet.";
+                return MidIPS::Status::OffsetOutOfRange;
+            }
+
+            // Byte by byte, as the copy may overlap what it writes.
+            for (size_t i = 0; i < length; i++)
+                output[outputOffset + i] = output[from + i];
+
+            from += length;
+            break;
+        }
+
+        outputOffset += length;
+        (*actionCount)++;
+    }
+
+    if (position != end || outputOffset != targetSize)
+    {
+        *error = "The patch is cut short.";
+        return MidIPS::Status::Truncated;
+    }
+    if (crc32(output, targetSize) != readLittleU32(patch + end + 4))
+    {
+        *error = "The patched file's checksum doesn't match.";
+        return MidIPS::Status::ChecksumMismatch;
+    }
+
+    return MidIPS::Status::Ok;
+}
+
+/**
+ * @param source
+ * @param sourceSize
+ * @param target
+ * @param targetSize
+ * @param output
+ *
+ * @brief Writes a BPS patch turning source
+ * into target into output.
+ *
+ * @details The target is walked once. Where it matches the
+ * source at the same offset, that's a SourceRead. Elsewhere,
+ * the window starting there is looked up by its rolling hash
+ * among the source's windows and the target's previous ones,
+ * so data that moved or got shifted by an insertion becomes
+ * a SourceCopy or a TargetCopy, extended both ways as far as
+ * it matches. Whatever is left is a TargetRead. Only one
+ * window every MATCH_WINDOW_SIZE bytes is remembered, so
+ * memory stays a fraction of the files' size.
+ *
+ * @returns How many actions the patch holds.
+ */
+size_t createBPS(const u8 *source, const size_t sourceSize, const u8 *target, const size_t targetSize, BigEdian *output)
+{
+    BPSWriter writer = {output, 0};
+    WindowTable sourceWindows = {sourceSize};
+    WindowTable targetWindows = {targetSize};
+    const u32 weight = outgoingWeight();
+    size_t sourceRelative = 0;
+    size_t targetRelative = 0;
+    size_t literalStart = 0;
+    size_t targetIndexed = 0;
+    size_t actionCount = 0;
+    size_t offset = 0;
+    bool isHashed = false;
+    u32 hash = 0;
+
+    writeBytes(&writer, sBPSMagic, BPS_MAGIC_LENGTH);
+    writeNumber(&writer, sourceSize);
+    writeNumber(&writer, targetSize);
+    writeNumber(&writer, 0);
+
+    for (size_t i = 0; i + MATCH_WINDOW_SIZE <= sourceSize; i += MATCH_WINDOW_SIZE)
+        sourceWindows.insert(hashWindow(source + i), i);
+
+    while (offset < targetSize)
+    {
+        Action action = SourceRead;
+        size_t length = 0;
+        size_t from = offset;
+
+        // Only windows fully written already may be copied from.
+        for (; targetIndexed + MATCH_WINDOW_SIZE <= offset; targetIndexed += MATCH_WINDOW_SIZE)
+            targetWindows.insert(hashWindow(target + targetIndexed), targetIndexed);
+
+        if (offset < sourceSize)
+            length = findMismatch(source + offset, target + offset, std::min(sourceSize, targetSize) - offset);
+        if (length < SOURCE_READ_MINIMUM)
+            length = 0;
+
+        if (length < MATCH_WINDOW_SIZE && offset + MATCH_WINDOW_SIZE <= targetSize)
+        {
+            size_t candidate = 0;
+
+            if (!isHashed)
+                hash = hashWindow(target + offset);
+
+            isHashed = true;
+
+            if (sourceWindows.find(hash, &candidate) && std::memcmp(source + candidate, target + offset, MATCH_WINDOW_SIZE) == 0)
+            {
+                const size_t matched = MATCH_WINDOW_SIZE + findMismatch(source + candidate + MATCH_WINDOW_SIZE, target + offset + MATCH_WINDOW_SIZE, std::min(sourceSize - candidate, targetSize - offset) - MATCH_WINDOW_SIZE);
+
+                if (matched > length)
+                {
+                    action = SourceCopy;
+                    length = matched;
+                    from = candidate;
+                }
+            }
+            if (targetWindows.find(hash, &candidate) && std::memcmp(target + candidate, target + offset, MATCH_WINDOW_SIZE) == 0)
+            {
+                const size_t matched = MATCH_WINDOW_SIZE + findMismatch(target + candidate + MATCH_WINDOW_SIZE, target + offset + MATCH_WINDOW_SIZE, targetSize - offset - MATCH_WINDOW_SIZE);
+
+                if (matched > length)
+                {
+                    action = TargetCopy;
+                    length = matched;
+                    from = candidate;
+                }
+            }
+        }
+
+        if (length == 0)
+        {
+            // Rolling the window one byte further.
+            if (isHashed && offset + MATCH_WINDOW_SIZE < targetSize)
+                hash = (hash - target[offset] * weight) * ROLLING_PRIME + target[offset + MATCH_WINDOW_SIZE];
+            else
+                isHashed = false;
+
+            offset++;
+            continue;
+        }
+
+        const u8 *origin = action == TargetCopy ? target : source;
+
+        // The match may start within the pending TargetRead.
+        while (offset > literalStart && from > 0 && origin[from - 1] == target[offset - 1])
+        {
+            offset--;
+            from--;
+            length++;
+        }
+
+        if (offset > literalStart)
+        {
+            writeAction(&writer, TargetRead, offset - literalStart);
+            writeBytes(&writer, target + literalStart, offset - literalStart);
+            actionCount++;
+        }
+
+        writeAction(&writer, action, length);
+
+        if (action == SourceCopy)
+        {
+            writeRelative(&writer, from, &sourceRelative);
+            sourceRelative = from + length;
+        }
+        else if (action == TargetCopy)
+        {
+            writeRelative(&writer, from, &targetRelative);
+            targetRelative = from + length;
+        }
+
+        actionCount++;
+        offset += length;
+        literalStart = offset;
+        isHashed = false;
+    }
+
+    if (offset > literalStart)
+    {
+        writeAction(&writer, TargetRead, offset - literalStart);
+        writeBytes(&writer, target + literalStart, offset - literalStart);
+        actionCount++;
+    }
+
+    writeLittleU32(&writer, crc32(source, sourceSize));
+    writeLittleU32(&writer, crc32(target, targetSize));
+
+    // The patch's own checksum covers everything but itself.
+    writeLittleU32(&writer, writer.crc);
+    output->flush();
+
+    return actionCount;
+}
@@ -1,30 +1,134 @@
-#include "MidIPS.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif // __linux__
 #include "BigEdian.hpp"
 
+//! @brief Size of the blocks the reader fetches from the file at once.
+#define READ_BLOCK_SIZE (1 << 20)
+
+//! @brief Alignment of the blocks, both in memory and within the file.
+#define READ_BLOCK_ALIGNMENT 4096
+
+//! @brief Size of the buffer pending writes are collected into.
+#define WRITE_BUFFER_SIZE (1 << 20)
+
+//! @brief Writes at least that big skip the buffer and go out alongside it.
+#define WRITE_DIRECT_THRESHOLD (64 << 10)
+
+//! @brief Size of the block positional fills are written from.
+#define FILL_BLOCK_SIZE (64 << 10)
+
+//! @brief How many times a fill block is repeated within a single vectored write.
+#define FILL_CHUNK_COUNT 16
+
+//! @brief Size of the blocks clone() copies with when the kernel can't do it.
+#define COPY_BLOCK_SIZE (8 << 20)
+
+/**
+ * @param mode
+ *
+ * @brief Translates an std::ios_base::openmode
+ * into the matching open(2) flags.
+ *
+ * @details Mirrors what std::fstream does: in|out
+ * expects the file to exist, out alone creates or
+ * truncates it.
+ */
+static int openFlagsFor(const std::ios_base::openmode &mode)
+{
+    const bool isIn = (mode & std::ios::in) != 0;
+    const bool isOut = (mode & std::ios::out) != 0;
+    int flags = O_RDONLY;
+
+    if (isIn && isOut)
+        flags = O_RDWR;
+    else if (isOut)
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (isOut && (mode & std::ios::trunc))
+        flags |= O_CREAT | O_TRUNC;
+
+    return flags;
+}
+
 /**
  * @param fileName
  * @param mode
  *
  * @brief Constructor that tries
  * to open fileName in mode.
+ *
+ * @details Failing to do so isn't fatal, the
+ * object is simply not good() afterwards.
  */
 BigEdian::BigEdian(const std::string &fileName, const std::ios_base::openmode &mode)
 {
-    m_fileBuffer.open(fileName, mode);
+    struct stat fileStat;
 
-    if (!m_fileBuffer.is_open())
-        FATAL_ERROR("Unable to open '" << fileName << "' for reading.");
+    initialize(fileName, 0);
+    m_fd = open(fileName.c_str(), openFlagsFor(mode), 0644);
 
-    m_fileName = fileName;
-    m_fileBuffer.seekg(0, std::ios::end);
+    if (m_fd < 0)
+    {
+        fail(MidIPS::Status::OpenFailed);
+        return;
+    }
+    // If getting the size failed for whatever reason.
+    if (fstat(m_fd, &fileStat) != 0)
+    {
+        fail(MidIPS::Status::ReadFailed);
+        return;
+    }
 
-    // If the seeking failed for whatever reason.
-    if (m_fileBuffer.fail())
-        FATAL_ERROR("Errors occurred while reading '" << fileName << "'.");
+    m_size = fileStat.st_size;
 
-    m_size = m_fileBuffer.tellg();
-    m_fileBuffer.clear(); // Clearing any flag that could've been set.
-    m_fileBuffer.seekg(0, std::ios::beg);
+    // Files we only read from are mapped, the others
+    // go through the block buffer.
+    if (!(mode & std::ios::out))
+        tryMapping();
+}
+
+/**
+ * @param memory
+ * @param size
+ *
+ * @brief Constructor reading from size bytes
+ * already in memory, which have to outlive it.
+ *
+ * @details They're treated just like a mapped file.
+ */
+BigEdian::BigEdian(const u8 *memory, const size_t size)
+{
+    initialize("<memory>", size);
+
+    if (size == 0)
+        return;
+
+    m_mapping = const_cast<u8 *>(memory);
+    m_readBuffer = m_mapping;
+    m_readCapacity = m_size;
+    m_readLength = m_size;
+}
+
+/**
+ * @param memory
+ *
+ * @brief Constructor reading from and writing
+ * into memory, which grows as needed and has to
+ * outlive it.
+ */
+BigEdian::BigEdian(std::vector<u8> *memory)
+{
+    initialize("<memory>", memory->size());
+    m_memory = memory;
 }
 
 /**
@@ -32,37 +136,225 @@ BigEdian::BigEdian(const std::string &fileName, const std::ios_base::openmode &m
  */
 BigEdian::~BigEdian()
 {
-    m_fileBuffer.close();
+    flush();
+
+    if (m_mapping != nullptr && m_ownsMapping)
+        munmap(m_mapping, m_size);
+    if (m_mapping == nullptr)
+        std::free(m_readBuffer);
+    if (m_fd >= 0)
+        close(m_fd);
+
+    delete[] m_writeBuffer;
+}
+
+/**
+ * @param fileName
+ * @param size
+ *
+ * @brief Puts every member in its
+ * default state, shared by constructors.
+ */
+void BigEdian::initialize(const std::string &fileName, const size_t size)
+{
+    m_fd = -1;
+    m_fileName = fileName;
+    m_memory = nullptr;
+    m_status = MidIPS::Status::Ok;
+    m_size = size;
+    m_position = 0;
+    m_mapping = nullptr;
+    m_ownsMapping = false;
+    m_readBuffer = nullptr;
+    m_readCapacity = 0;
+    m_readStart = 0;
+    m_readLength = 0;
+    m_writeBuffer = nullptr;
+    m_writeStart = 0;
+    m_writeLength = 0;
+}
+
+/**
+ * @param status
+ *
+ * @brief Records an error, only the first
+ * one is kept as the others usually follow
+ * from it.
+ */
+void BigEdian::fail(const MidIPS::Status status)
+{
+    if (m_status == MidIPS::Status::Ok)
+        m_status = status;
+}
+
+/**
+ * @brief Tries to map the whole file in memory.
+ *
+ * @details On success, the mapping simply becomes
+ * a read buffer spanning the whole file, so every
+ * read takes the fast paths. On failure (empty file,
+ * not a regular file, ...) we silently keep the block
+ * buffer.
+ */
+void BigEdian::tryMapping()
+{
+    if (m_size == 0)
+        return;
+
+    void *mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+
+    if (mapping == MAP_FAILED)
+        return;
+
+    madvise(mapping, m_size, MADV_SEQUENTIAL);
+
+    m_mapping = static_cast<u8 *>(mapping);
+    m_ownsMapping = true;
+    m_readBuffer = m_mapping;
+    m_readCapacity = m_size;
+    m_readStart = 0;
+    m_readLength = m_size;
+}
+
+/**
+ * @brief Returns how many bytes starting at
+ * the current position are already buffered.
+ */
+size_t BigEdian::bufferedLength() const
+{
+    if (m_position < m_readStart || m_position >= m_readStart + m_readLength)
+        return 0;
+
+    return m_readStart + m_readLength - m_position;
+}
+
+/**
+ * @param minimum
+ *
+ * @brief Fetches the aligned block holding
+ * the current position into the read buffer.
+ *
+ * @details The buffer grows if minimum bytes
+ * starting at the current position can't fit
+ * in a single block.
+ */
+void BigEdian::fillReadBuffer(const size_t minimum)
+{
+    // Pending writes have to reach the file first,
+    // otherwise we could read stale bytes.
+    flush();
+
+    m_readStart = m_position & ~static_cast<size_t>(READ_BLOCK_ALIGNMENT - 1);
+    m_readLength = 0;
+
+    size_t wanted = (m_position - m_readStart) + minimum;
+
+    if (wanted < READ_BLOCK_SIZE)
+        wanted = READ_BLOCK_SIZE;
+    if (wanted > m_readCapacity)
+    {
+        wanted = (wanted + READ_BLOCK_ALIGNMENT - 1) & ~static_cast<size_t>(READ_BLOCK_ALIGNMENT - 1);
+        std::free(m_readBuffer);
+
+        m_readCapacity = 0;
+
+        if (posix_memalign(reinterpret_cast<void **>(&m_readBuffer), READ_BLOCK_ALIGNMENT, wanted) != 0)
+        {
+            m_readBuffer = nullptr;
+            fail(MidIPS::Status::ReadFailed);
+            return;
+        }
+
+        m_readCapacity = wanted;
+    }
+
+    if (m_memory != nullptr)
+    {
+        if (m_readStart < m_memory->size())
+            m_readLength = std::min(m_readCapacity, m_memory->size() - m_readStart);
+
+        std::memcpy(m_readBuffer, m_memory->data() + m_readStart, m_readLength);
+        return;
+    }
+
+    // pread() is allowed to return less than asked,
+    // so we keep going until the block is full or the file ends.
+    while (m_readLength < m_readCapacity)
+    {
+        ssize_t readCount = pread(m_fd, m_readBuffer + m_readLength, m_readCapacity - m_readLength, m_readStart + m_readLength);
+
+        if (readCount < 0)
+            fail(MidIPS::Status::ReadFailed);
+        if (readCount <= 0)
+            break;
+
+        m_readLength += readCount;
+    }
+}
+
+/**
+ * @param offset
+ * @param length
+ *
+ * @brief Drops the read buffer if it overlaps
+ * with a range that has just been written.
+ */
+void BigEdian::invalidateReadBuffer(const size_t offset, const size_t length)
+{
+    if (offset < m_readStart + m_readLength && m_readStart < offset + length)
+        m_readLength = 0;
 }
 
 /**
  * @brief Reads an 8-bit
  * unsigned integer.
  *
- * @returns The read u8.
+ * @returns The read u8, or 0 when reading
+ * past the end, which makes the object fail.
  */
 u8 BigEdian::readU8()
 {
     if (isEnd())
-        FATAL_ERROR("Reached end of file: '" << m_fileName << "'.");
+    {
+        fail(MidIPS::Status::Truncated);
+        return 0;
+    }
+    if (bufferedLength() == 0)
+        fillReadBuffer(1);
+    if (bufferedLength() == 0)
+        return 0;
 
-    return m_fileBuffer.get();
+    return m_readBuffer[m_position++ - m_readStart];
 }
 
 /**
+ * @param length
+ *
  * @brief Reads an array
  * of 8-bit unsigned integer(s).
  *
- * @returns The read u8 *.
+ * @returns A view over the read bytes, owned by
+ * this object: it stays valid as long as the file
+ * is open when mapped, and until the next read or
+ * write otherwise. nullptr when reading past the
+ * end, which makes the object fail.
  */
-u8 *BigEdian::readBytes(const size_t &length)
+const u8 *BigEdian::readBytes(const size_t &length)
 {
-    u8 *readArray = new u8[length];
+    if (m_position > m_size || length > m_size - m_position)
+    {
+        fail(MidIPS::Status::Truncated);
+        return nullptr;
+    }
+    if (bufferedLength() < length)
+        fillReadBuffer(length);
+    if (bufferedLength() < length)
+        return nullptr;
 
-    for (size_t i = 0; i < length; i++)
-        readArray[i] = readU8();
+    const u8 *view = m_readBuffer + (m_position - m_readStart);
+    m_position += length;
 
-    return readArray;
+    return view;
 }
 
 /**
@@ -73,6 +365,15 @@ u8 *BigEdian::readBytes(const size_t &length)
  */
 u16 BigEdian::readU16()
 {
+    // Fast path, both bytes are already in the buffer.
+    if (bufferedLength() >= 2)
+    {
+        const u8 *bytes = m_readBuffer + (m_position - m_readStart);
+        m_position += 2;
+
+        return (bytes[0] << BITS_IN(u8)) | bytes[1];
+    }
+
     u16 retVal = readU8();
     retVal <<= BITS_IN(u8);
     retVal |= readU8();
@@ -89,6 +390,14 @@ u16 BigEdian::readU16()
  */
 u32 BigEdian::readU24()
 {
+    if (bufferedLength() >= 3)
+    {
+        const u8 *bytes = m_readBuffer + (m_position - m_readStart);
+        m_position += 3;
+
+        return (bytes[0] << BITS_IN(u16)) | (bytes[1] << BITS_IN(u8)) | bytes[2];
+    }
+
     u32 retVal = readU16();
     retVal <<= BITS_IN(u8);
     retVal |= readU8();
@@ -111,6 +420,21 @@ u32 BigEdian::readU32()
     return retVal;
 }
 
+/**
+ * @brief Reads a 64-bit
+ * unsigned integer.
+ *
+ * @returns The read u64.
+ */
+u64 BigEdian::readU64()
+{
+    u64 retVal = readU32();
+    retVal <<= BITS_IN(u32);
+    retVal |= readU32();
+
+    return retVal;
+}
+
 /**
  * @param toWrite
  *
@@ -119,8 +443,20 @@ u32 BigEdian::readU32()
  */
 void BigEdian::writeU8(const u8 &toWrite)
 {
-    m_fileBuffer.put(toWrite);
-    m_fileBuffer.flush();
+    // Fast path, simply appending to the pending bytes.
+    if (m_writeLength > 0 && m_writeLength < WRITE_BUFFER_SIZE && m_position == m_writeStart + m_writeLength)
+    {
+        m_writeBuffer[m_writeLength++] = toWrite;
+        invalidateReadBuffer(m_position, 1);
+        m_position++;
+
+        if (m_position > m_size)
+            m_size = m_position;
+
+        return;
+    }
+
+    writeBytes(&toWrite, 1);
 }
 
 /**
@@ -132,8 +468,46 @@ void BigEdian::writeU8(const u8 &toWrite)
  */
 void BigEdian::writeBytes(const u8 *toWrite, const size_t &length)
 {
-    for (size_t i = 0; i < length; i++)
-        writeU8(toWrite[i]);
+    if (length == 0)
+        return;
+    // The pending bytes aren't followed by these ones.
+    if (m_writeLength > 0 && m_position != m_writeStart + m_writeLength)
+        flush();
+    if (m_writeBuffer == nullptr)
+        m_writeBuffer = new u8[WRITE_BUFFER_SIZE];
+    if (m_writeLength == 0)
+        m_writeStart = m_position;
+
+    if (length >= WRITE_DIRECT_THRESHOLD || length > WRITE_BUFFER_SIZE - m_writeLength)
+    {
+        // Too big to be worth copying, so the pending bytes
+        // and these ones go out together in a single vectored write.
+        struct iovec chunks[2];
+
+        chunks[0].iov_base = m_writeBuffer;
+        chunks[0].iov_len = m_writeLength;
+        chunks[1].iov_base = const_cast<u8 *>(toWrite);
+        chunks[1].iov_len = length;
+
+        if (!writeChunks(chunks, 2, m_writeStart))
+            fail(MidIPS::Status::WriteFailed);
+
+        m_writeLength = 0;
+    }
+    else
+    {
+        std::memcpy(m_writeBuffer + m_writeLength, toWrite, length);
+        m_writeLength += length;
+
+        if (m_writeLength == WRITE_BUFFER_SIZE)
+            flush();
+    }
+
+    invalidateReadBuffer(m_position, length);
+    m_position += length;
+
+    if (m_position > m_size)
+        m_size = m_position;
 }
 
 /**
@@ -185,37 +559,323 @@ void BigEdian::writeU32(const u32 &toWrite)
     writeU16(lo);
 }
 
+/**
+ * @param toWrite
+ *
+ * @brief Writes a 64-bit unsigned integer.
+ */
+void BigEdian::writeU64(const u64 &toWrite)
+{
+    u32 hi = (toWrite >> BITS_IN(u32));
+    u32 lo = (toWrite);
+
+    writeU32(hi);
+    writeU32(lo);
+}
+
+/**
+ * @param offset
+ * @param toWrite
+ * @param length
+ *
+ * @brief Writes length bytes at offset, without
+ * going through the position nor the buffers.
+ *
+ * @details Safe to call from several threads at once,
+ * as long as they write disjoint ranges within the current
+ * size, see resize(). Pending writes have to be flushed
+ * before, and reload() called after.
+ *
+ * @returns Whether everything got written, the object's
+ * state is left untouched as several threads may fail.
+ */
+bool BigEdian::writeAt(const size_t offset, const u8 *toWrite, const size_t length) const
+{
+    struct iovec chunk;
+
+    chunk.iov_base = const_cast<u8 *>(toWrite);
+    chunk.iov_len = length;
+
+    return writeChunks(&chunk, 1, offset);
+}
+
+/**
+ * @param chunks
+ * @param count
+ * @param offset
+ *
+ * @brief Writes count contiguous chunks at offset,
+ * with as few pwritev() calls as possible.
+ */
+bool BigEdian::writeChunks(struct iovec *chunks, int count, size_t offset) const
+{
+    if (m_memory != nullptr)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (offset + chunks[i].iov_len > m_memory->size())
+                m_memory->resize(offset + chunks[i].iov_len);
+
+            std::memcpy(m_memory->data() + offset, chunks[i].iov_base, chunks[i].iov_len);
+            offset += chunks[i].iov_len;
+        }
+
+        return true;
+    }
+
+    while (count > 0)
+    {
+        ssize_t writeCount = pwritev(m_fd, chunks, count, offset);
+
+        if (writeCount <= 0)
+            return false;
+
+        offset += writeCount;
+
+        // Skipping whatever has been fully written, and
+        // moving into the chunk that has been partially written.
+        while (count > 0 && static_cast<size_t>(writeCount) >= chunks->iov_len)
+        {
+            writeCount -= chunks->iov_len;
+            chunks++;
+            count--;
+        }
+        if (count > 0)
+        {
+            chunks->iov_base = static_cast<u8 *>(chunks->iov_base) + writeCount;
+            chunks->iov_len -= writeCount;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @param offset
+ * @param block
+ * @param blockSize
+ * @param count
+ *
+ * @brief Writes count bytes at offset, repeating
+ * block over and over.
+ *
+ * @details The same block is referenced several
+ * times by each vectored write, so nothing but
+ * the block itself ever needs to be filled.
+ */
+bool BigEdian::writeRepeated(size_t offset, const u8 *block, const size_t blockSize, size_t count) const
+{
+    struct iovec chunks[FILL_CHUNK_COUNT];
+
+    while (count > 0)
+    {
+        int chunkCount = 0;
+        size_t batchSize = 0;
+
+        while (count > 0 && chunkCount < FILL_CHUNK_COUNT)
+        {
+            const size_t chunkSize = count < blockSize ? count : blockSize;
+
+            chunks[chunkCount].iov_base = const_cast<u8 *>(block);
+            chunks[chunkCount].iov_len = chunkSize;
+            chunkCount++;
+            batchSize += chunkSize;
+            count -= chunkSize;
+        }
+
+        if (!writeChunks(chunks, chunkCount, offset))
+            return false;
+
+        offset += batchSize;
+    }
+
+    return true;
+}
+
+/**
+ * @param value
+ * @param count
+ *
+ * @brief Writes value count times, e.g. for
+ * an 'RLE'.
+ *
+ * @details Fills are simply memset into the write buffer,
+ * like any other write. Those too big for it fill the whole
+ * buffer once, and then write it as many times as needed.
+ */
+void BigEdian::fill(const u8 &value, const size_t &count)
+{
+    if (count == 0)
+        return;
+    if (m_writeBuffer == nullptr)
+        m_writeBuffer = new u8[WRITE_BUFFER_SIZE];
+
+    if (count >= WRITE_BUFFER_SIZE)
+    {
+        flush();
+        std::memset(m_writeBuffer, value, WRITE_BUFFER_SIZE);
+
+        if (!writeRepeated(m_position, m_writeBuffer, WRITE_BUFFER_SIZE, count))
+            fail(MidIPS::Status::WriteFailed);
+    }
+    else
+    {
+        // The pending bytes aren't followed by these ones.
+        if (m_writeLength > 0 && m_position != m_writeStart + m_writeLength)
+            flush();
+        if (m_writeLength > WRITE_BUFFER_SIZE - count)
+            flush();
+        if (m_writeLength == 0)
+            m_writeStart = m_position;
+
+        std::memset(m_writeBuffer + m_writeLength, value, count);
+        m_writeLength += count;
+    }
+
+    invalidateReadBuffer(m_position, count);
+    m_position += count;
+
+    if (m_position > m_size)
+        m_size = m_position;
+}
+
+/**
+ * @param offset
+ * @param value
+ * @param count
+ *
+ * @brief Same as fill(), but at offset, and without
+ * going through the position nor the buffers.
+ *
+ * @details Same rules as writeAt() apply.
+ */
+bool BigEdian::fillAt(const size_t offset, const u8 &value, const size_t count) const
+{
+    u8 block[FILL_BLOCK_SIZE];
+    const size_t blockSize = count < FILL_BLOCK_SIZE ? count : FILL_BLOCK_SIZE;
+
+    std::memset(block, value, blockSize);
+    return writeRepeated(offset, block, blockSize, count);
+}
+
+/**
+ * @param size
+ *
+ * @brief Grows or shrinks the file to
+ * size bytes in one go.
+ *
+ * @details New bytes read as zeroes. When growing
+ * a file, its blocks are allocated right away if the
+ * file system can, so that it doesn't get fragmented
+ * by the writes that follow.
+ */
+void BigEdian::resize(const size_t size)
+{
+    bool isResized = false;
+
+    flush();
+
+    if (m_memory != nullptr)
+    {
+        m_memory->resize(size);
+        isResized = true;
+    }
+#ifdef __linux__
+    else if (size > m_size)
+    {
+        isResized = fallocate(m_fd, 0, m_size, size - m_size) == 0;
+    }
+#endif // __linux__
+
+    if (!isResized && ftruncate(m_fd, size) != 0)
+    {
+        fail(MidIPS::Status::WriteFailed);
+        return;
+    }
+
+    invalidateReadBuffer(std::min(size, m_size), size > m_size ? size - m_size : m_size - size);
+    m_size = size;
+}
+
 /**
  * @brief Flushes the changes, i.e.
  * writes the buffer into the real file.
  */
 void BigEdian::flush()
 {
-    m_fileBuffer.flush();
+    if (m_writeLength == 0)
+        return;
+
+    struct iovec chunk;
+
+    chunk.iov_base = m_writeBuffer;
+    chunk.iov_len = m_writeLength;
+
+    if (!writeChunks(&chunk, 1, m_writeStart))
+        fail(MidIPS::Status::WriteFailed);
+
+    m_writeLength = 0;
+}
+
+/**
+ * @brief Catches up with writes that didn't go
+ * through this object, i.e. writeAt().
+ *
+ * @details Drops whatever is buffered and fetches
+ * the file's size again. Mapped files are read-only,
+ * so there's nothing to catch up with.
+ */
+void BigEdian::reload()
+{
+    struct stat fileStat;
+
+    if (m_mapping != nullptr)
+        return;
+
+    flush();
+    m_readLength = 0;
+
+    if (m_memory != nullptr)
+    {
+        m_size = m_memory->size();
+        return;
+    }
+    if (fstat(m_fd, &fileStat) != 0)
+    {
+        fail(MidIPS::Status::ReadFailed);
+        return;
+    }
+
+    m_size = fileStat.st_size;
 }
 
 /**
  * @param offset
  *
  * @brief Seeks a certain position.
+ *
+ * @details Seeking anywhere but right after
+ * the pending bytes flushes them.
  */
 void BigEdian::seek(const size_t offset)
 {
-    m_fileBuffer.seekg(offset, std::ios::beg);
-    m_fileBuffer.seekp(offset, std::ios::beg);
+    if (offset != m_writeStart + m_writeLength)
+        flush();
+
+    m_position = offset;
 }
 
 /**
  * @brief Tells our current position.
  *
- * @returns The get position, as we rarely
- * need this in write mode.
+ * @returns The position shared by
+ * reads and writes.
  *
  * @todo Make this const.
  */
 size_t BigEdian::tell()
 {
-    return m_fileBuffer.tellg();
+    return m_position;
 }
 
 /**
@@ -232,9 +892,183 @@ size_t BigEdian::size()
  * @brief Returns whether we're at
  * the end of the file or not.
  *
+ * @details Once every byte has been
+ * read, any further read is fatal.
+ *
  * @todo Make this const.
  */
 bool BigEdian::isEnd()
 {
-    return m_fileBuffer.eof();
-}
\ No newline at end of file
+    return m_position >= m_size;
+}
+
+/**
+ * @brief Returns whether the whole
+ * file is mapped in memory.
+ */
+bool BigEdian::isMapped() const
+{
+    return m_mapping != nullptr;
+}
+
+/**
+ * @brief Returns the mapped content of
+ * the file, or nullptr if it isn't mapped.
+ */
+const u8 *BigEdian::data() const
+{
+    return m_mapping;
+}
+
+/**
+ * @brief Returns whether nothing
+ * went wrong so far.
+ */
+bool BigEdian::good() const
+{
+    return m_status == MidIPS::Status::Ok;
+}
+
+/**
+ * @brief Returns the first error
+ * that happened, if any.
+ */
+MidIPS::Status BigEdian::status() const
+{
+    return m_status;
+}
+
+/**
+ * @brief Describes the first error that
+ * happened, along with the file's name.
+ */
+std::string BigEdian::error() const
+{
+    switch (m_status)
+    {
+    case MidIPS::Status::Ok:
+        return "";
+    case MidIPS::Status::OpenFailed:
+        return "Unable to open '" + m_fileName + "'.";
+    case MidIPS::Status::Truncated:
+        return "Reached end of file: '" + m_fileName + "'.";
+    case MidIPS::Status::WriteFailed:
+        return "Errors occurred while writing '" + m_fileName + "'.";
+    default:
+        return "Errors occurred while reading '" + m_fileName + "'.";
+    }
+}
+
+/**
+ * @param sourceFd
+ * @param destinationFd
+ * @param size
+ *
+ * @brief Lets the kernel copy size bytes from
+ * sourceFd to destinationFd.
+ *
+ * @returns Whether the kernel did it, it may refuse
+ * e.g. across file systems or on older kernels.
+ */
+static bool kernelCopy(const int sourceFd, const int destinationFd, const size_t size)
+{
+#ifdef __linux__
+    // Sharing the extents is basically free, when the file system can.
+    if (ioctl(destinationFd, FICLONE, sourceFd) == 0)
+        return true;
+
+    size_t copied = 0;
+
+    while (copied < size)
+    {
+        ssize_t copyCount = copy_file_range(sourceFd, nullptr, destinationFd, nullptr, size - copied, 0);
+
+        if (copyCount <= 0)
+            break;
+
+        copied += copyCount;
+    }
+
+    if (copied == size)
+        return true;
+
+    // Starting over from scratch with the plain copy.
+    if (ftruncate(destinationFd, 0) != 0 || lseek(sourceFd, 0, SEEK_SET) != 0 || lseek(destinationFd, 0, SEEK_SET) != 0)
+        return false;
+#endif // __linux__
+
+    return false;
+}
+
+/**
+ * @param sourceName
+ * @param destinationName
+ *
+ * @brief Makes destinationName an exact copy
+ * of sourceName.
+ *
+ * @details Tries a reflink, then copy_file_range(),
+ * so that the data doesn't have to go through us,
+ * and falls back to copying big blocks.
+ */
+MidIPS::Status BigEdian::clone(const std::string &sourceName, const std::string &destinationName)
+{
+    struct stat sourceStat;
+    struct stat destinationStat;
+    const int sourceFd = open(sourceName.c_str(), O_RDONLY);
+
+    if (sourceFd < 0)
+        return MidIPS::Status::OpenFailed;
+    if (fstat(sourceFd, &sourceStat) != 0)
+    {
+        close(sourceFd);
+        return MidIPS::Status::ReadFailed;
+    }
+
+    // Truncating it would wipe the source itself.
+    if (stat(destinationName.c_str(), &destinationStat) == 0 && destinationStat.st_dev == sourceStat.st_dev && destinationStat.st_ino == sourceStat.st_ino)
+    {
+        close(sourceFd);
+        return MidIPS::Status::Ok;
+    }
+
+    const int destinationFd = open(destinationName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, sourceStat.st_mode & 0777);
+    MidIPS::Status retVal = MidIPS::Status::Ok;
+
+    if (destinationFd < 0)
+    {
+        close(sourceFd);
+        return MidIPS::Status::OpenFailed;
+    }
+
+    if (!kernelCopy(sourceFd, destinationFd, sourceStat.st_size))
+    {
+        u8 *block = new u8[COPY_BLOCK_SIZE];
+        ssize_t readCount = 0;
+
+        while (retVal == MidIPS::Status::Ok && (readCount = read(sourceFd, block, COPY_BLOCK_SIZE)) > 0)
+        {
+            for (ssize_t written = 0; written < readCount;)
+            {
+                ssize_t writeCount = write(destinationFd, block + written, readCount - written);
+
+                if (writeCount <= 0)
+                {
+                    retVal = MidIPS::Status::WriteFailed;
+                    break;
+                }
+
+                written += writeCount;
+            }
+        }
+
+        if (readCount < 0)
+            retVal = MidIPS::Status::ReadFailed;
+
+        delete[] block;
+    }
+
+    close(sourceFd);
+    close(destinationFd);
+    return retVal;
+}
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+#include "BlockIndex.hpp"
+#include "Sha256.hpp"
+
+//! @brief Header of every index, translates literally to "MIDX".
+static const u8 sIndexMagic[] = {0x4D, 0x49, 0x44, 0x58};
+
+//! @brief Size of the index's magic.
+#define INDEX_MAGIC_LENGTH sizeof(sIndexMagic)
+
+//! @brief Version of the index format, bumped on any change to it.
+#define INDEX_VERSION 1
+
+//! @brief Size of the blocks each hash covers.
+#define INDEX_BLOCK_SIZE (64 << 10)
+
+/**
+ * @param fileName
+ * @param size
+ * @param modifiedTime
+ *
+ * @brief Gets fileName's size and last
+ * modification time, in nanoseconds.
+ *
+ * @returns Whether the file could be stat()'ed.
+ */
+static bool statFile(const std::string &fileName, u64 *size, u64 *modifiedTime)
+{
+    struct stat fileStat;
+
+    if (stat(fileName.c_str(), &fileStat) != 0)
+        return false;
+
+    *size = fileStat.st_size;
+    *modifiedTime = static_cast<u64>(fileStat.st_mtim.tv_sec) * 1000000000 + fileStat.st_mtim.tv_nsec;
+    return true;
+}
+
+/**
+ * @param indexName
+ *
+ * @brief Constructor that loads the index
+ * written by build() into indexName.
+ *
+ * @details The index is mapped, so the hashes are
+ * never copied. Failing to load it isn't fatal,
+ * the object is simply not good() afterwards.
+ */
+BlockIndex::BlockIndex(const std::string &indexName) : m_file(indexName, std::ios::in | std::ios::binary)
+{
+    m_status = m_file.status();
+    m_blockSize = 0;
+    m_sourceSize = 0;
+    m_modifiedTime = 0;
+    m_blockCount = 0;
+    m_hashes = nullptr;
+
+    if (!m_file.good())
+        return;
+
+    const u8 *magic = m_file.readBytes(INDEX_MAGIC_LENGTH);
+
+    if (magic == nullptr || std::memcmp(magic, sIndexMagic, INDEX_MAGIC_LENGTH) != 0 || m_file.readU32() != INDEX_VERSION)
+    {
+        m_status = MidIPS::Status::InvalidHeader;
+        return;
+    }
+
+    m_blockSize = m_file.readU32();
+    m_sourceSize = m_file.readU64();
+    m_modifiedTime = m_file.readU64();
+
+    if (m_blockSize == 0)
+    {
+        m_status = MidIPS::Status::InvalidHeader;
+        return;
+    }
+
+    m_blockCount = (m_sourceSize + m_blockSize - 1) / m_blockSize;
+    m_hashes = m_file.readBytes(m_blockCount * SHA256_SIZE);
+    m_status = m_file.status();
+}
+
+/**
+ * @brief Returns whether the
+ * index could be loaded.
+ */
+bool BlockIndex::good() const
+{
+    return m_status == MidIPS::Status::Ok;
+}
+
+/**
+ * @brief Returns why the index
+ * couldn't be loaded, if it couldn't.
+ */
+MidIPS::Status BlockIndex::status() const
+{
+    return m_status;
+}
+
+/**
+ * @brief Describes why the index
+ * couldn't be loaded, if it couldn't.
+ */
+std::string BlockIndex::error() const
+{
+    if (m_status == MidIPS::Status::InvalidHeader)
+        return "The passed file is not a valid index.";
+
+    return m_file.error();
+}
+
+/**
+ * @param sourceName
+ *
+ * @brief Checks whether the index was built from
+ * sourceName, as it is now.
+ *
+ * @details Compares the size and the last modification
+ * time, so that the file doesn't have to be read.
+ */
+bool BlockIndex::matches(const std::string &sourceName) const
+{
+    u64 size = 0;
+    u64 modifiedTime = 0;
+
+    return good() && statFile(sourceName, &size, &modifiedTime) && size == m_sourceSize && modifiedTime == m_modifiedTime;
+}
+
+/**
+ * @brief Returns the size of the
+ * blocks each hash covers.
+ */
+u32 BlockIndex::blockSize() const
+{
+    return m_blockSize;
+}
+
+/**
+ * @brief Returns how many blocks, and
+ * so hashes, the index holds.
+ */
+size_t BlockIndex::blockCount() const
+{
+    return m_blockCount;
+}
+
+/**
+ * @param block
+ *
+ * @brief Returns the SHA-256 digest of
+ * the block-th block of the source.
+ */
+const u8 *BlockIndex::hash(const size_t block) const
+{
+    return m_hashes + block * SHA256_SIZE;
+}
+
+/**
+ * @param sourceName
+ * @param indexName
+ *
+ * @brief Hashes sourceName block by block,
+ * and writes the index into indexName.
+ *
+ * @details The index is made of a header, with the
+ * format's version, the block size, and the source's
+ * size and last modification time, followed by the
+ * SHA-256 digest of each block.
+ */
+MidIPS::Status BlockIndex::build(const std::string &sourceName, const std::string &indexName)
+{
+    BigEdian source = {sourceName, std::ios::in | std::ios::binary};
+    u64 size = 0;
+    u64 modifiedTime = 0;
+    u8 digest[SHA256_SIZE];
+
+    if (!source.good())
+        return source.status();
+    if (!statFile(sourceName, &size, &modifiedTime))
+        return MidIPS::Status::ReadFailed;
+
+    BigEdian index = {indexName, std::ios::out | std::ios::binary};
+
+    if (!index.good())
+        return index.status();
+
+    index.writeBytes(sIndexMagic, INDEX_MAGIC_LENGTH);
+    index.writeU32(INDEX_VERSION);
+    index.writeU32(INDEX_BLOCK_SIZE);
+    index.writeU64(size);
+    index.writeU64(modifiedTime);
+
+    while (!source.isEnd())
+    {
+        const size_t length = std::min(source.size() - source.tell(), static_cast<size_t>(INDEX_BLOCK_SIZE));
+        const u8 *block = source.readBytes(length);
+
+        if (block == nullptr)
+            return source.status();
+
+        sha256(block, length, digest);
+        index.writeBytes(digest, SHA256_SIZE);
+    }
+
+    index.flush();
+    return index.status();
+}
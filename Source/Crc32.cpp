@@ -0,0 +1,82 @@
+#include "Crc32.hpp"
+
+//! @brief Reversed polynomial of the CRC-32 used by zlib, BPS and UPS.
+#define CRC32_POLYNOMIAL 0xEDB88320
+
+//! @brief Bytes folded into the CRC at once, one table each.
+#define CRC32_SLICES 8
+
+//! @brief The CRC of every possible byte, followed by 0 to 7 zeros.
+struct CrcTable
+{
+    u32 entries[CRC32_SLICES][256];
+
+    CrcTable()
+    {
+        for (u32 i = 0; i < 256; i++)
+        {
+            u32 crc = i;
+
+            for (size_t bit = 0; bit < BITS_IN(u8); bit++)
+                crc = (crc >> 1) ^ (crc & 1 ? CRC32_POLYNOMIAL : 0);
+
+            entries[0][i] = crc;
+        }
+
+        // Each slice is the previous one, pushed through a zero byte.
+        for (size_t slice = 1; slice < CRC32_SLICES; slice++)
+        {
+            for (u32 i = 0; i < 256; i++)
+                entries[slice][i] = (entries[slice - 1][i] >> 8) ^ entries[0][entries[slice - 1][i] & 0xFF];
+        }
+    }
+};
+
+/**
+ * @param bytes
+ *
+ * @brief Reads a little-endian u32,
+ * whatever the machine's order.
+ */
+static u32 loadLittle(const u8 *bytes)
+{
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<u32>(bytes[3]) << 24);
+}
+
+/**
+ * @param bytes
+ * @param length
+ * @param crc
+ *
+ * @brief Computes the CRC-32 of bytes.
+ *
+ * @details crc is the CRC of whatever came before,
+ * so that it can be computed piece by piece. It goes
+ * 8 bytes at a time, slice-by-8: each of them is looked
+ * up in its own table, which already accounts for the
+ * bytes following it, so the lookups don't depend on
+ * each other. That's several times faster than going
+ * byte by byte, which only handles what's left.
+ */
+u32 crc32(const u8 *bytes, const size_t length, const u32 crc)
+{
+    // Built once, on first use.
+    static const CrcTable table;
+    const u32(&slices)[CRC32_SLICES][256] = table.entries;
+    u32 retVal = ~crc;
+    size_t i = 0;
+
+    for (; i + CRC32_SLICES <= length; i += CRC32_SLICES)
+    {
+        const u32 low = loadLittle(bytes + i) ^ retVal;
+        const u32 high = loadLittle(bytes + i + 4);
+
+        retVal = slices[7][low & 0xFF] ^ slices[6][(low >> 8) & 0xFF] ^ slices[5][(low >> 16) & 0xFF] ^ slices[4][low >> 24] ^
+                 slices[3][high & 0xFF] ^ slices[2][(high >> 8) & 0xFF] ^ slices[1][(high >> 16) & 0xFF] ^ slices[0][high >> 24];
+    }
+
+    for (; i < length; i++)
+        retVal = (retVal >> 8) ^ slices[0][(retVal ^ bytes[i]) & 0xFF];
+
+    return ~retVal;
+}
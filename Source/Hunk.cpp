@@ -1,5 +1,11 @@
-#include "MidIPS.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include "Hunk.hpp"
+#include "Scan.hpp"
+
+//! @brief How many bytes fromDiff() compares at once when the files aren't mapped.
+#define DIFF_WINDOW_SIZE (64 << 10)
 
 /**
  * @param offset
@@ -10,9 +16,12 @@
  * @brief Default constructor.
  *
  * @details Basically just copies all
- * the given arguments to its core.
+ * the given arguments to its core. A Hunk
+ * never owns its bytes, they live in the patch,
+ * the target, or an Arena, so copying or moving
+ * one is as cheap as copying its fields.
  */
-Hunk::Hunk(const u32 offset, const u16 length, const u16 count, std::vector<u8> *bytes)
+Hunk::Hunk(const size_t offset, const u16 length, const u16 count, const u8 *bytes)
 {
     m_offset = offset;
     m_length = length;
@@ -20,68 +29,12 @@ Hunk::Hunk(const u32 offset, const u16 length, const u16 count, std::vector<u8>
     m_bytes = bytes;
 }
 
-/**
- * @param hunk
- *
- * @brief Copy constructor.
- */
-Hunk::Hunk(Hunk &hunk)
-{
-    *this = hunk;
-
-    // If it isn't a self assignment, we can
-    // set the hunk's m_bytes to nullptr so that
-    // it doesn't delete this object's by 'accident'.
-    if (&hunk != this)
-        hunk.m_bytes = nullptr;
-}
-
-/**
- * @param hunk
- *
- * @brief Move constructor.
- */
-Hunk::Hunk(Hunk &&hunk)
-{
-    *this = hunk;
-
-    // Same thing as above.
-    if (&hunk != this)
-        hunk.m_bytes = nullptr;
-}
-
-/**
- * @brief Destructor.
- */
-Hunk::~Hunk()
-{
-    delete m_bytes;
-}
-
-/**
- * @param source
- *
- * @brief Assignment operator.
- */
-Hunk &Hunk::operator=(const Hunk &source)
-{
-    // If it is a self assignment, there's no point.
-    if (&source == this)
-        return *this;
-
-    m_offset = source.offset();
-    m_length = source.length();
-    m_count = source.count();
-    m_bytes = source.bytes();
-    return *this;
-}
-
 /**
  * @brief Returns the offset at
  * which the Hunk was/will be
  * located at.
  */
-u32 Hunk::offset() const
+size_t Hunk::offset() const
 {
     return m_offset;
 }
@@ -108,194 +61,337 @@ u16 Hunk::count() const
 /**
  * @brief Returns the bytes
  * this Hunk is composed by.
+ *
+ * @details For an 'RLE', only
+ * the first one is meaningful.
  */
-std::vector<u8> *Hunk::bytes() const
+const u8 *Hunk::bytes() const
 {
     return m_bytes;
 }
 
 /**
- * @param destination
- *
- * @brief Writes the Hunk into
- * destination.
- *
- * @todo Maybe rename this into applyHunk ?
- *
- * @todo Delete toWrite at the end of the function.
+ * @brief Returns how many bytes the
+ * Hunk covers once written.
  */
-void Hunk::write(BigEdian *destination, bool allowAboveU24)
+size_t Hunk::size() const
 {
-    if (m_offset >= destination->size())
-    {
-        char offsetBuf[10];
-        char destSize[10];
-
-        sprintf(offsetBuf, "0x%X", m_offset);
-        sprintf(destSize, "0x%lX", destination->size());
-
-        FATAL_ERROR("Specified offset: " << offsetBuf << " is bigger than file size: " << destSize << ".");
-    }
-    if ((m_length == 0 && m_count == 0) || m_bytes == nullptr)
-        return;
-    // Superior to 16 MB.
-    if (!allowAboveU24 && m_offset > U24_MAX)
-    {
-        INFO("The patch *will not* consider data after 0xFFFFFF, skipping.");
-        return;
-    }
-
-    destination->seek(m_offset);
+    return m_length > 0 ? m_length : m_count;
+}
 
-    // It isn't RLE.
-    if (m_length > 0)
-    {
-        destination->writeBytes(m_bytes->data(), m_length);
-        return;
-    }
+/**
+ * @brief Returns whether the
+ * Hunk holds nothing to write.
+ */
+bool Hunk::isEmpty() const
+{
+    return (m_length == 0 && m_count == 0) || m_bytes == nullptr;
+}
 
-    // It is RLE, so we iteratively
-    // write the same byte over and over.
-    u8 *toWrite = new u8[m_count];
+/**
+ * @param start
+ * @param end
+ *
+ * @brief Returns the part of the Hunk
+ * that covers the [start, end) range.
+ */
+Hunk Hunk::slice(const size_t start, const size_t end) const
+{
+    const u16 size = end - start;
 
-    for (size_t i = 0; i < m_count; i++)
-        toWrite[i] = m_bytes->at(0);
+    // It is RLE, so any part of it is the same byte.
+    if (m_length == 0)
+        return Hunk(start, 0, size, m_bytes);
 
-    destination->writeBytes(toWrite, m_count);
+    return Hunk(start, size, 0, m_bytes + (start - m_offset));
 }
 
 /**
  * @param destination
+ * @param isIPS32
+ *
+ * @brief Writes the Hunk as an IPS, or
+ * IPS32, record into destination.
  *
- * @brief Writes the Hunk as IPS into
- * destination.
+ * @details The offset is expected to fit,
+ * see offsetLimit(), the patch's flavour
+ * being picked from the target's size.
  */
-void Hunk::asIPS(BigEdian *destination, bool allowAboveU24)
+void Hunk::asIPS(BigEdian *destination, const bool isIPS32) const
 {
-    if ((m_length == 0 && m_count == 0) || m_bytes == nullptr)
+    if (isEmpty())
         return;
-    // Superior to 16 MB.
-    if (!allowAboveU24 && m_offset > U24_MAX)
-    {
-        INFO("The patch *will not* consider data after 0xFFFFFF, skipping.");
-        return;
-    }
 
-    destination->writeU24(m_offset);
+    if (isIPS32)
+        destination->writeU32(m_offset);
+    else
+        destination->writeU24(m_offset);
+
     destination->writeU16(m_length);
 
     // It is RLE.
     if (m_length == 0)
     {
         destination->writeU16(m_count);
-        destination->writeU8(m_bytes->at(0));
+        destination->writeU8(m_bytes[0]);
     }
     else
     {
-        destination->writeBytes(m_bytes->data(), m_length);
+        destination->writeBytes(m_bytes, m_length);
     }
 }
 
 /**
  * @param ipsParser
+ * @param isIPS32
+ * @param arena
  *
- * @brief Tries to parse a Hunk from
- * an IPS File.
+ * @brief Tries to parse a Hunk from an IPS File,
+ * its offset taking 4 bytes in an IPS32 one.
+ *
+ * @details The Hunk points straight into the patch. When
+ * it isn't mapped, that's only valid until the next read,
+ * so if an arena is given the bytes are copied into it.
  */
-Hunk Hunk::fromIPS(BigEdian *ipsParser, bool allowAboveU24)
+Hunk Hunk::fromIPS(BigEdian *ipsParser, const bool isIPS32, Arena *arena)
 {
-    u32 offset = allowAboveU24 ? ipsParser->readU32() : ipsParser->readU24();
+    size_t offset = isIPS32 ? ipsParser->readU32() : ipsParser->readU24();
     u16 length = ipsParser->readU16();
     u16 count = 0;
-    std::vector<u8> *bytes = new std::vector<u8>();
 
     // It is RLE.
     if (length == 0)
-    {
         count = ipsParser->readU16();
-        bytes->push_back(ipsParser->readU8());
-    }
+
+    const size_t payloadLength = length == 0 ? 1 : length;
+    const u8 *bytes = ipsParser->readBytes(payloadLength);
+
+    // A payload cut short gives no bytes, the parser failing already.
+    if (bytes != nullptr && arena != nullptr && !ipsParser->isMapped())
+        bytes = arena->store(bytes, payloadLength);
+
+    return Hunk(offset, length, count, bytes);
+}
+
+/**
+ * @param ipsParser
+ * @param isIPS32
+ *
+ * @brief Parses a Hunk's header from an IPS
+ * File, and steps over its payload.
+ *
+ * @details Nothing gets read from the payload, so the
+ * Hunk has no bytes and only its fields are meaningful.
+ * A payload cut short still fails the parser.
+ */
+Hunk Hunk::skipIPS(BigEdian *ipsParser, const bool isIPS32)
+{
+    size_t offset = isIPS32 ? ipsParser->readU32() : ipsParser->readU24();
+    u16 length = ipsParser->readU16();
+    u16 count = 0;
+
+    // It is RLE.
+    if (length == 0)
+        count = ipsParser->readU16();
+
+    const size_t payloadLength = length == 0 ? 1 : length;
+
+    if (ipsParser->tell() + payloadLength > ipsParser->size())
+        ipsParser->readBytes(payloadLength);
     else
+        ipsParser->seek(ipsParser->tell() + payloadLength);
+
+    return Hunk(offset, length, count, nullptr);
+}
+
+/**
+ * @param ipsParser
+ * @param isIPS32
+ * @param truncateSize
+ *
+ * @brief Checks whether ipsParser is at the
+ * "EOF" marker, or "EEOF" for IPS32, and
+ * steps over it if so.
+ *
+ * @details The marker is only recognized as the
+ * very last record, optionally followed by the
+ * truncate extension, as wide as an offset, which
+ * then goes into truncateSize. Anything else is
+ * left for fromIPS() to parse as a Hunk.
+ */
+bool Hunk::endsIPS(BigEdian *ipsParser, const bool isIPS32, size_t *truncateSize)
+{
+    const size_t start = ipsParser->tell();
+    const size_t remaining = ipsParser->size() - start;
+    const size_t width = isIPS32 ? 4 : 3;
+
+    if (remaining != width && remaining != width * 2)
+        return false;
+    if ((isIPS32 ? ipsParser->readU32() : ipsParser->readU24()) != endMarker(isIPS32))
     {
-        const u8 *data = ipsParser->readBytes(length);
+        ipsParser->seek(start);
+        return false;
+    }
+    if (remaining == width * 2)
+        *truncateSize = isIPS32 ? ipsParser->readU32() : ipsParser->readU24();
+
+    return true;
+}
+
+/**
+ * @param isIPS32
+ *
+ * @brief Returns the offset other patchers
+ * take for the end of an IPS, or IPS32, patch.
+ */
+size_t Hunk::endMarker(const bool isIPS32)
+{
+    return isIPS32 ? IPS32_END_MARKER : IPS_END_MARKER;
+}
 
-        bytes->reserve(length);
+/**
+ * @param isIPS32
+ *
+ * @brief Returns the highest offset an
+ * IPS, or IPS32, record can hold.
+ */
+size_t Hunk::offsetLimit(const bool isIPS32)
+{
+    return isIPS32 ? U32_MAX : U24_MAX;
+}
 
-        for (size_t i = 0; i < length; i++)
-            bytes->push_back(data[i]);
+/**
+ * @param offset
+ * @param bytes
+ * @param size
+ *
+ * @brief Builds a Hunk out of size differing
+ * bytes, as an 'RLE' if they're all the same.
+ */
+Hunk Hunk::fromBytes(const size_t offset, const u8 *bytes, const u16 size)
+{
+    // There was no diff at all.
+    if (size == 0)
+        return Hunk(offset, 0, 0, nullptr);
+
+    for (size_t i = 1; i < size; i++)
+    {
+        if (bytes[i] != bytes[0])
+            return Hunk(offset, size, 0, bytes);
     }
 
-    return Hunk(offset, length, count, bytes);
+    return Hunk(offset, 0, size, bytes);
+}
+
+/**
+ * @param source
+ * @param target
+ *
+ * @brief Same as fromDiff, but scans both
+ * mappings directly in memory instead of going
+ * through read windows.
+ *
+ * @details The Hunk points into the target's mapping.
+ */
+Hunk Hunk::fromMappedDiff(BigEdian *source, BigEdian *target)
+{
+    const u8 *sourceData = source->data();
+    const u8 *targetData = target->data();
+    const size_t end = std::min(source->size(), target->size());
+    size_t position = source->tell();
+
+    position += findMismatch(sourceData + position, targetData + position, end - position);
+
+    const size_t offset = position;
+
+    position += findMatch(sourceData + position, targetData + position, std::min(end - position, static_cast<size_t>(U16_MAX)));
+
+    source->seek(position);
+    target->seek(position);
+
+    return fromBytes(offset, targetData + offset, position - offset);
 }
 
 /**
  * @param source
  * @param target
+ * @param arena
  *
  * @brief Creates a Hunk from
  * the difference between source and target.
+ *
+ * @details Unless both files are mapped, both are compared
+ * window by window and the differing bytes are collected
+ * into arena, which is expected to be reset by the caller
+ * once the Hunk has been used. Either way, the comparisons
+ * go through the vectorized scans.
  */
-Hunk Hunk::fromDiff(BigEdian *source, BigEdian *target)
+Hunk Hunk::fromDiff(BigEdian *source, BigEdian *target, Arena *arena)
 {
     if (source->isEnd() || target->isEnd())
-        FATAL_ERROR("Reached end of file(s).");
+        return Hunk(source->tell(), 0, 0, nullptr);
+    if (source->isMapped() && target->isMapped())
+        return fromMappedDiff(source, target);
 
-    u32 offset = 0;
-    std::vector<u8> *diffBytes = new std::vector<u8>();
-    u16 length = 0;
-    u16 count = 0;
-    bool isRLE = true;
+    const size_t end = std::min(source->size(), target->size());
+    size_t offset = source->tell();
+    u8 *diffBytes = nullptr;
+    u16 size = 0;
 
-    while (!source->isEnd() && !target->isEnd())
+    while (offset < end)
     {
-        offset = source->tell();
+        const size_t length = std::min(end - offset, static_cast<size_t>(DIFF_WINDOW_SIZE));
+        const u8 *sourceBytes = source->readBytes(length);
+        const u8 *targetBytes = target->readBytes(length);
+
+        if (sourceBytes == nullptr || targetBytes == nullptr)
+            return Hunk(offset, 0, 0, nullptr);
 
-        u8 byteSource = source->readU8();
-        u8 byteTarget = target->readU8();
+        const size_t equalCount = findMismatch(sourceBytes, targetBytes, length);
 
-        if (byteSource == byteTarget)
+        // Same window, skipping it entirely.
+        if (equalCount == length)
+        {
+            offset += length;
             continue;
+        }
 
-        for (size_t i = 0; i < U16_MAX; i++)
+        size_t start = equalCount;
+        size_t windowLength = length;
+
+        offset += equalCount;
+        diffBytes = arena->allocate(U16_MAX);
+
+        while (true)
         {
-            diffBytes->push_back(byteTarget);
-
-            if (isRLE)
-                count++;
-            else
-                length++;
-
-            // It's suddenly not RLE anymore, so now
-            // length has to be the one that gets udpated.
-            if (isRLE && i > 0 && diffBytes->at(i - 1) != byteTarget)
-            {
-                isRLE = false;
-                length = count;
-                count = 0;
-            }
-
-            byteSource = source->readU8();
-            byteTarget = target->readU8();
-
-            // If they're the same, it's not a diff anymore.
-            if (byteSource == byteTarget)
+            const size_t runLength = findMatch(sourceBytes + start, targetBytes + start, std::min(windowLength - start, static_cast<size_t>(U16_MAX - size)));
+
+            std::memcpy(diffBytes + size, targetBytes + start, runLength);
+            size += runLength;
+
+            // It's not a diff anymore, the Hunk is full,
+            // or there's nothing left to compare.
+            if (start + runLength < windowLength || size == U16_MAX || offset + size == end)
                 break;
-            if (source->isEnd() || target->isEnd())
+
+            windowLength = std::min(end - offset - size, static_cast<size_t>(DIFF_WINDOW_SIZE));
+            sourceBytes = source->readBytes(windowLength);
+            targetBytes = target->readBytes(windowLength);
+            start = 0;
+
+            if (sourceBytes == nullptr || targetBytes == nullptr)
                 break;
         }
 
         break;
     }
 
-    // There was no diff at all, so we can free
-    // the diffBytes pointer.
-    if (length == 0 && count == 0)
-    {
-        delete diffBytes;
-        diffBytes = nullptr;
-    }
+    // The next Hunk starts right after this one,
+    // even if more has been read.
+    source->seek(offset + size);
+    target->seek(offset + size);
 
-    return Hunk(offset, length, count, diffBytes);
+    return fromBytes(offset, diffBytes, size);
 }
 
 /**
@@ -305,18 +401,18 @@ Hunk Hunk::fromDiff(BigEdian *source, BigEdian *target)
  * @brief Lets you print a Hunk
  * into std::cout, and any std::ostream.
  */
-std::ostream &operator<<(std::ostream &out, Hunk &hunk)
+std::ostream &operator<<(std::ostream &out, const Hunk &hunk)
 {
     std::string offsetAsString = {""};
     std::string lengthAsString = {""};
     std::string countAsString = {""};
     std::string bytesAsString = {""};
-    char hexBuffer[10];
-    std::vector<u8> *bytesData = hunk.bytes();
+    char hexBuffer[20];
+    const u8 *bytesData = hunk.bytes();
 
     // Formatting to be 'readable', there's surely a better way,
     // but this one works just fine.
-    sprintf(hexBuffer, "0x%X", hunk.offset());
+    sprintf(hexBuffer, "0x%lX", hunk.offset());
     offsetAsString = hexBuffer;
     sprintf(hexBuffer, "0x%X", hunk.length());
     lengthAsString = hexBuffer;
@@ -330,17 +426,15 @@ std::ostream &operator<<(std::ostream &out, Hunk &hunk)
     }
     else if (hunk.length() == 0)
     {
-        sprintf(hexBuffer, "0x%X", *(hunk.bytes()->data()));
+        sprintf(hexBuffer, "0x%X", bytesData[0]);
         bytesAsString = hexBuffer;
     }
     else
     {
         bytesAsString = "{";
-        u8 *bytes = hunk.bytes()->data();
-
         for (size_t i = 0, max = hunk.length(); i < max; i++)
         {
-            sprintf(hexBuffer, "0x%X", bytes[i]);
+            sprintf(hexBuffer, "0x%X", bytesData[i]);
 
             bytesAsString += hexBuffer;
 
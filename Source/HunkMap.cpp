@@ -0,0 +1,93 @@
+#include "HunkMap.hpp"
+
+/**
+ * @param hunk
+ *
+ * @brief Writes hunk over whatever
+ * the map already holds there.
+ *
+ * @details The Hunks it overlaps are erased, but for
+ * their parts before and after it, which are kept as
+ * slices, so the map's Hunks never overlap.
+ */
+void HunkMap::write(const Hunk &hunk)
+{
+    if (hunk.isEmpty())
+        return;
+
+    const size_t start = hunk.offset();
+    const size_t end = start + hunk.size();
+    std::map<size_t, Hunk>::iterator it = m_hunks.upper_bound(start);
+
+    if (it != m_hunks.begin() && std::prev(it)->first + std::prev(it)->second.size() > start)
+        it--;
+
+    while (it != m_hunks.end() && it->first < end)
+    {
+        const Hunk current = it->second;
+        const size_t currentEnd = current.offset() + current.size();
+
+        it = m_hunks.erase(it);
+
+        if (current.offset() < start)
+            m_hunks.insert(std::make_pair(current.offset(), current.slice(current.offset(), start)));
+        if (currentEnd > end)
+            m_hunks.insert(std::make_pair(end, current.slice(end, currentEnd)));
+    }
+
+    m_hunks.insert(std::make_pair(start, hunk));
+}
+
+/**
+ * @param size
+ *
+ * @brief Drops everything the map
+ * holds from size onwards.
+ */
+void HunkMap::truncate(const size_t size)
+{
+    std::map<size_t, Hunk>::iterator it = m_hunks.lower_bound(size);
+
+    m_hunks.erase(it, m_hunks.end());
+
+    if (m_hunks.empty())
+        return;
+
+    const Hunk last = m_hunks.rbegin()->second;
+
+    if (last.offset() + last.size() > size)
+        m_hunks.rbegin()->second = last.slice(last.offset(), size);
+}
+
+/**
+ * @param offset
+ * @param byte
+ *
+ * @brief Gets the byte written at offset.
+ *
+ * @returns Whether any Hunk covers offset.
+ */
+bool HunkMap::byteAt(const size_t offset, u8 *byte) const
+{
+    std::map<size_t, Hunk>::const_iterator it = m_hunks.upper_bound(offset);
+
+    if (it == m_hunks.begin())
+        return false;
+
+    const Hunk &current = (--it)->second;
+
+    if (offset >= current.offset() + current.size())
+        return false;
+
+    *byte = current.length() > 0 ? current.bytes()[offset - current.offset()] : current.bytes()[0];
+    return true;
+}
+
+/**
+ * @brief Returns the Hunks, sorted by
+ * offset, none of them overlapping.
+ */
+const std::map<size_t, Hunk> &HunkMap::hunks() const
+{
+    return m_hunks;
+}
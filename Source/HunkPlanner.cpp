@@ -0,0 +1,188 @@
+#include <algorithm>
+#include "HunkPlanner.hpp"
+
+//! @brief Size of the length of an IPS record, which follows its offset.
+#define RECORD_LENGTH_SIZE 2
+
+//! @brief Size of what an RLE record has past its header: count and value.
+#define RLE_PAYLOAD_SIZE 3
+
+//! @brief Pending bytes are planned once they reach that, so memory stays bounded.
+#define PLAN_WINDOW_SIZE (1 << 20)
+
+/**
+ * @param readTarget
+ * @param onPlanned
+ * @param isIPS32
+ *
+ * @brief Constructor, readTarget is how the bytes
+ * between two Hunks are read from the target.
+ *
+ * @details Those bytes always are a few bytes before
+ * the Hunk being pushed. Planned Hunks are handed to
+ * onPlanned one by one, their bytes are only valid
+ * until it returns. An IPS32 patch has wider headers,
+ * and another end marker to steer clear of.
+ */
+HunkPlanner::HunkPlanner(const std::function<void(size_t offset, size_t length, u8 *bytes)> &readTarget, const std::function<void(const Hunk &)> &onPlanned, const bool isIPS32)
+{
+    m_readTarget = readTarget;
+    m_onPlanned = onPlanned;
+    m_start = 0;
+    m_endMarker = Hunk::endMarker(isIPS32);
+    m_headerSize = (isIPS32 ? 4 : 3) + RECORD_LENGTH_SIZE;
+}
+
+/**
+ * @param offset
+ * @param length
+ *
+ * @brief Appends length bytes of the
+ * target, from offset, to the pending ones.
+ *
+ * @details Those bytes are the same in both
+ * files, and the diff has gone past them.
+ */
+void HunkPlanner::appendGap(const size_t offset, const size_t length)
+{
+    const size_t pendingSize = m_pending.size();
+
+    m_pending.resize(pendingSize + length);
+    m_readTarget(offset, length, m_pending.data() + pendingSize);
+}
+
+/**
+ * @param start
+ * @param end
+ *
+ * @brief Hands out the pending [start, end)
+ * bytes as literal Hunks.
+ */
+void HunkPlanner::emitLiteral(const size_t start, const size_t end)
+{
+    for (size_t i = start; i < end;)
+    {
+        // Other patchers would take it for the end marker, so it starts
+        // a byte earlier, the pending bytes never start there.
+        if (m_start + i == m_endMarker)
+            i--;
+
+        const u16 length = std::min(end - i, static_cast<size_t>(U16_MAX));
+
+        m_onPlanned(Hunk(m_start + i, length, 0, m_pending.data() + i));
+        i += length;
+    }
+}
+
+/**
+ * @param start
+ * @param end
+ *
+ * @brief Hands out the pending [start, end)
+ * bytes, which are all the same, as RLE Hunks.
+ */
+void HunkPlanner::emitRLE(const size_t start, const size_t end)
+{
+    for (size_t i = start; i < end;)
+    {
+        // Same as in emitLiteral(), the literal takes the byte before.
+        if (m_start + i == m_endMarker)
+        {
+            emitLiteral(i, i + 1);
+            i++;
+            continue;
+        }
+
+        const u16 count = std::min(end - i, static_cast<size_t>(U16_MAX));
+
+        m_onPlanned(Hunk(m_start + i, 0, count, m_pending.data() + i));
+        i += count;
+    }
+}
+
+/**
+ * @brief Splits the pending bytes into the
+ * cheapest Hunks, and hands them out.
+ *
+ * @details Goes from left to right over runs of the
+ * same byte. A run becomes an RLE Hunk when that's
+ * smaller than keeping it within the literal around it,
+ * which costs a new header if it splits the literal in
+ * two, or starts one.
+ */
+void HunkPlanner::plan()
+{
+    const size_t size = m_pending.size();
+    size_t literalStart = 0;
+    size_t i = 0;
+
+    while (i < size)
+    {
+        size_t j = i + 1;
+
+        while (j < size && m_pending[j] == m_pending[i])
+            j++;
+
+        const size_t literalCost = (j - i) + (literalStart < i ? 0 : m_headerSize);
+        const size_t RLECost = m_headerSize + RLE_PAYLOAD_SIZE + (j < size ? m_headerSize : 0);
+
+        if (RLECost < literalCost)
+        {
+            emitLiteral(literalStart, i);
+            emitRLE(i, j);
+            literalStart = j;
+        }
+
+        i = j;
+    }
+
+    emitLiteral(literalStart, size);
+    m_pending.clear();
+}
+
+/**
+ * @param diffHunk
+ *
+ * @brief Adds the next Hunk found by the diff.
+ *
+ * @details When it's close enough to the pending ones that
+ * repeating the bytes in between is cheaper than a new header,
+ * they're kept together. Otherwise, the pending ones get
+ * planned first.
+ */
+void HunkPlanner::push(const Hunk &diffHunk)
+{
+    if (diffHunk.isEmpty())
+        return;
+
+    const size_t pendingEnd = m_start + m_pending.size();
+
+    if (!m_pending.empty() && diffHunk.offset() - pendingEnd <= m_headerSize && m_pending.size() < PLAN_WINDOW_SIZE)
+    {
+        appendGap(pendingEnd, diffHunk.offset() - pendingEnd);
+    }
+    else
+    {
+        finish();
+        m_start = diffHunk.offset();
+
+        // Taking the byte before, see emitLiteral().
+        if (m_start == m_endMarker)
+            appendGap(--m_start, 1);
+    }
+
+    if (diffHunk.length() > 0)
+        m_pending.insert(m_pending.end(), diffHunk.bytes(), diffHunk.bytes() + diffHunk.length());
+    else
+        m_pending.insert(m_pending.end(), diffHunk.count(), diffHunk.bytes()[0]);
+}
+
+/**
+ * @brief Plans and hands out
+ * whatever is still pending.
+ */
+void HunkPlanner::finish()
+{
+    if (!m_pending.empty())
+        plan();
+}
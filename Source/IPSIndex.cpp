@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <thread>
+#include "IPSIndex.hpp"
+
+/**
+ * @param offset
+ * @param size
+ *
+ * @brief Describes a Hunk starting
+ * past the end of the file.
+ */
+static std::string outOfRange(const size_t offset, const size_t size)
+{
+    char offsetBuf[20];
+    char destSize[20];
+
+    std::snprintf(offsetBuf, sizeof(offsetBuf), "0x%lX", offset);
+    std::snprintf(destSize, sizeof(destSize), "0x%lX", size);
+
+    return std::string("Specified offset: ") + offsetBuf + " is bigger than file size: " + destSize + ".";
+}
+
+/**
+ * @param destination
+ * @param writes
+ * @param first
+ * @param last
+ * @param succeeded
+ *
+ * @brief Writes the [first, last) writes into
+ * destination, with positional writes only.
+ *
+ * @details That's what each thread runs, the
+ * ranges given to them never overlap.
+ */
+static void applyWrites(const BigEdian *destination, const std::vector<Hunk> *writes, const size_t first, const size_t last, char *succeeded)
+{
+    *succeeded = true;
+
+    for (size_t i = first; i < last && *succeeded; i++)
+    {
+        const Hunk &current = writes->at(i);
+
+        if (current.length() > 0)
+            *succeeded = destination->writeAt(current.offset(), current.bytes(), current.length());
+        else
+            *succeeded = destination->fillAt(current.offset(), current.bytes()[0], current.count());
+    }
+}
+
+/**
+ * @param destination
+ * @param start
+ * @param end
+ * @param original
+ * @param onOverwrite
+ *
+ * @brief Hands the [start, end) bytes of destination
+ * to onOverwrite, before they get overwritten.
+ *
+ * @details They're copied into original first, as the
+ * callback may read destination again before using them.
+ */
+static void readOriginal(BigEdian *destination, const size_t start, const size_t end, std::vector<u8> *original, const std::function<void(const Hunk &)> &onOverwrite)
+{
+    for (size_t i = start; i < end; i += U16_MAX)
+    {
+        const u16 length = std::min(end - i, static_cast<size_t>(U16_MAX));
+
+        destination->seek(i);
+
+        const u8 *bytes = destination->readBytes(length);
+
+        if (bytes == nullptr)
+            return;
+
+        original->assign(bytes, bytes + length);
+        onOverwrite(Hunk(i, length, 0, original->data()));
+    }
+}
+
+/**
+ * @brief Constructor, the index
+ * starts out empty.
+ */
+IPSIndex::IPSIndex()
+{
+    m_truncateSize = SIZE_MAX;
+}
+
+/**
+ * @param ipsParser
+ * @param isIPS32
+ *
+ * @brief Parses every Hunk left in ipsParser,
+ * i.e. everything after the header.
+ *
+ * @details Only the Hunks' fields are kept, side by
+ * side, while the payloads stay in the patch's mapping,
+ * or get copied into the index's Arena otherwise. It stops
+ * at the "EOF" marker, or "EEOF" for IPS32, keeping the
+ * truncate size if any.
+ *
+ * @returns The parser's status, e.g. Truncated if
+ * the last Hunk is cut short.
+ */
+MidIPS::Status IPSIndex::parse(BigEdian *ipsParser, const bool isIPS32)
+{
+    while (!ipsParser->isEnd() && ipsParser->good() && !Hunk::endsIPS(ipsParser, isIPS32, &m_truncateSize))
+    {
+        Hunk parsed = Hunk::fromIPS(ipsParser, isIPS32, &m_arena);
+
+        m_offsets.push_back(parsed.offset());
+        m_lengths.push_back(parsed.length());
+        m_counts.push_back(parsed.count());
+        m_payloads.push_back(parsed.bytes());
+    }
+
+    return ipsParser->status();
+}
+
+/**
+ * @brief Returns how many Hunks
+ * the patch is made of.
+ */
+size_t IPSIndex::hunkCount() const
+{
+    return m_offsets.size();
+}
+
+/**
+ * @param index
+ *
+ * @brief Returns the index-th Hunk,
+ * in the patch's order.
+ */
+Hunk IPSIndex::hunk(const size_t index) const
+{
+    return Hunk(m_offsets[index], m_lengths[index], m_counts[index], m_payloads[index]);
+}
+
+/**
+ * @brief Returns whether the patch ends with
+ * the truncate extension.
+ */
+bool IPSIndex::hasTruncate() const
+{
+    return m_truncateSize != SIZE_MAX;
+}
+
+/**
+ * @brief Returns the size the patch
+ * truncates the file to, if it does.
+ */
+size_t IPSIndex::truncateSize() const
+{
+    return m_truncateSize;
+}
+
+/**
+ * @param destinationSize
+ * @param resolution
+ *
+ * @brief Turns the Hunks into disjoint writes,
+ * sorted by offset, into resolution.
+ *
+ * @details Hunks are walked from the last one to the first,
+ * each only keeping the parts no later Hunk already covers,
+ * so overlapping Hunks still end up with the last one winning,
+ * just like applying them in the patch's order. The index
+ * itself is left untouched, so one parsed patch can be resolved
+ * against several files at once.
+ *
+ * @returns OffsetOutOfRange if a Hunk starts past the end of
+ * the file, as grown by the previous ones.
+ */
+MidIPS::Status IPSIndex::resolve(const size_t destinationSize, IPSResolution *resolution) const
+{
+    std::vector<bool> isSkipped(hunkCount(), false);
+    size_t grownSize = destinationSize;
+
+    // First checking every offset, in the patch's order as
+    // earlier Hunks may make the file grow, so nothing gets
+    // written if one of them is invalid.
+    for (size_t i = 0, max = hunkCount(); i < max; i++)
+    {
+        const Hunk current = hunk(i);
+
+        if (current.offset() > grownSize)
+        {
+            resolution->error = outOfRange(current.offset(), grownSize);
+            return MidIPS::Status::OffsetOutOfRange;
+        }
+        if (current.isEmpty())
+        {
+            isSkipped[i] = true;
+            continue;
+        }
+        if (current.offset() + current.size() > grownSize)
+            grownSize = current.offset() + current.size();
+    }
+
+    // Ranges already claimed by later Hunks, start -> end,
+    // merged whenever they touch.
+    std::map<size_t, size_t> covered;
+
+    resolution->writes.clear();
+
+    for (size_t i = hunkCount(); i-- > 0;)
+    {
+        if (isSkipped[i])
+            continue;
+
+        const Hunk current = hunk(i);
+        const size_t start = current.offset();
+        const size_t end = start + current.size();
+        size_t cursor = start;
+        size_t mergedStart = start;
+        size_t mergedEnd = end;
+        std::map<size_t, size_t>::iterator it = covered.upper_bound(start);
+
+        if (it != covered.begin() && std::prev(it)->second >= start)
+            it--;
+
+        while (it != covered.end() && it->first <= end)
+        {
+            // The gap before the next claimed range is ours.
+            if (it->first > cursor)
+                resolution->writes.push_back(current.slice(cursor, it->first));
+
+            cursor = std::max(cursor, it->second);
+            mergedStart = std::min(mergedStart, it->first);
+            mergedEnd = std::max(mergedEnd, it->second);
+            it = covered.erase(it);
+        }
+
+        if (cursor < end)
+            resolution->writes.push_back(current.slice(cursor, end));
+
+        covered[mergedStart] = mergedEnd;
+    }
+
+    std::sort(resolution->writes.begin(), resolution->writes.end(), [](const Hunk &a, const Hunk &b)
+              { return a.offset() < b.offset(); });
+
+    resolution->resolvedSize = grownSize;
+    return MidIPS::Status::Ok;
+}
+
+/**
+ * @param resolution
+ *
+ * @brief Returns the size of the file once the
+ * resolution's writes are done and it's truncated,
+ * a truncation past the writes being ignored.
+ */
+size_t IPSIndex::finalSize(const IPSResolution &resolution) const
+{
+    return hasTruncate() ? std::min(m_truncateSize, resolution.resolvedSize) : resolution.resolvedSize;
+}
+
+/**
+ * @param destination
+ * @param threadCount
+ * @param resolution
+ * @param onOverwrite
+ *
+ * @brief Applies the whole patch into
+ * destination, resolved into resolution.
+ *
+ * @details Writes happen in ascending offset order, so
+ * touching ones get merged by the BigEdian's write buffer.
+ * With more than one thread, the sorted writes are split into
+ * consecutive groups of about the same amount of bytes, and
+ * each thread writes its own group. As the writes are disjoint,
+ * the result is the same whatever order they land in. A file
+ * that grows does so upfront in one go, and one that the patch
+ * truncates is truncated last, nothing being written past the
+ * size it's truncated to. If there's an onOverwrite, it gets
+ * the original bytes of the file, in ascending offset order,
+ * right before they're overwritten or truncated.
+ *
+ * @returns The first error met, if any.
+ */
+MidIPS::Status IPSIndex::apply(BigEdian *destination, const size_t threadCount, IPSResolution *resolution, const std::function<void(const Hunk &)> &onOverwrite) const
+{
+    const size_t originalSize = destination->size();
+    const MidIPS::Status resolved = resolve(originalSize, resolution);
+
+    if (resolved != MidIPS::Status::Ok)
+        return resolved;
+
+    const size_t finalSize = this->finalSize(*resolution);
+    std::vector<Hunk> &writes = resolution->writes;
+    std::vector<u8> original;
+
+    // Whatever lies past the final size would be truncated right away.
+    while (!writes.empty() && writes.back().offset() >= finalSize)
+        writes.pop_back();
+    if (!writes.empty() && writes.back().offset() + writes.back().size() > finalSize)
+        writes.back() = writes.back().slice(writes.back().offset(), finalSize);
+
+    // Growing it upfront, so that the writes, and
+    // the threads, only ever land within the file.
+    if (finalSize > originalSize)
+        destination->resize(finalSize);
+
+    if (threadCount > 1 && writes.size() > 1)
+    {
+        std::vector<std::thread> workers;
+        std::vector<char> succeeded(threadCount, false);
+        size_t totalSize = 0;
+        size_t doneSize = 0;
+        size_t first = 0;
+
+        for (size_t i = 0, max = writes.size(); i < max; i++)
+        {
+            totalSize += writes[i].size();
+
+            if (onOverwrite && writes[i].offset() < originalSize)
+                readOriginal(destination, writes[i].offset(), std::min(writes[i].offset() + writes[i].size(), originalSize), &original, onOverwrite);
+        }
+
+        destination->flush();
+
+        for (size_t i = 0, max = writes.size(); i < max; i++)
+        {
+            doneSize += writes[i].size();
+
+            // This group has its share, or it's the very last write.
+            if (doneSize * threadCount >= totalSize * (workers.size() + 1) || i + 1 == max)
+            {
+                workers.push_back(std::thread(applyWrites, destination, &writes, first, i + 1, &succeeded[workers.size()]));
+                first = i + 1;
+            }
+        }
+
+        for (size_t i = 0, max = workers.size(); i < max; i++)
+            workers[i].join();
+
+        destination->reload();
+
+        for (size_t i = 0, max = workers.size(); i < max; i++)
+        {
+            if (!succeeded[i])
+                return MidIPS::Status::WriteFailed;
+        }
+    }
+    else
+    {
+        for (size_t i = 0, max = writes.size(); i < max; i++)
+        {
+            const Hunk &current = writes[i];
+
+            if (onOverwrite && current.offset() < originalSize)
+                readOriginal(destination, current.offset(), std::min(current.offset() + current.size(), originalSize), &original, onOverwrite);
+
+            destination->seek(current.offset());
+
+            if (current.length() > 0)
+                destination->writeBytes(current.bytes(), current.length());
+            else
+                destination->fill(current.bytes()[0], current.count());
+        }
+
+        destination->flush();
+    }
+
+    if (finalSize < originalSize)
+    {
+        if (onOverwrite)
+            readOriginal(destination, finalSize, originalSize, &original, onOverwrite);
+
+        destination->resize(finalSize);
+    }
+
+    return destination->status();
+}
+
+/**
+ * @param ipsParser
+ * @param destinationSize
+ * @param isIPS32
+ * @param summary
+ *
+ * @brief Checks every Hunk left in ipsParser against a
+ * file of destinationSize bytes, without applying them.
+ *
+ * @details Only the Hunks' headers are read, the payloads
+ * are stepped over and nothing is kept, so it's a fraction
+ * of the cost of parse(). The rules are the same as in
+ * resolve(), and summary gets what the patch would do.
+ *
+ * @returns Truncated if the patch is cut short, or
+ * OffsetOutOfRange if a Hunk starts past the end of the file.
+ */
+MidIPS::Status IPSIndex::validate(BigEdian *ipsParser, const size_t destinationSize, const bool isIPS32, IPSSummary *summary)
+{
+    size_t truncateSize = SIZE_MAX;
+
+    summary->hunkCount = 0;
+    summary->byteCount = 0;
+    summary->outputSize = destinationSize;
+
+    while (!ipsParser->isEnd() && !Hunk::endsIPS(ipsParser, isIPS32, &truncateSize))
+    {
+        const Hunk current = Hunk::skipIPS(ipsParser, isIPS32);
+
+        if (!ipsParser->good())
+            return ipsParser->status();
+
+        summary->hunkCount++;
+
+        if (current.offset() > summary->outputSize)
+        {
+            summary->error = outOfRange(current.offset(), summary->outputSize);
+            return MidIPS::Status::OffsetOutOfRange;
+        }
+        if (current.size() == 0)
+            continue;
+
+        summary->byteCount += current.size();
+
+        if (current.offset() + current.size() > summary->outputSize)
+            summary->outputSize = current.offset() + current.size();
+    }
+
+    // Same as finalSize(), a truncation past the writes is ignored.
+    if (truncateSize != SIZE_MAX)
+        summary->outputSize = std::min(truncateSize, summary->outputSize);
+
+    return ipsParser->status();
+}
@@ -0,0 +1,2057 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <thread>
+#include "LibMidIPS.hpp"
+#include "Arena.hpp"
+#include "BigEdian.hpp"
+#include "BlockIndex.hpp"
+#include "BPS.hpp"
+#include "Crc32.hpp"
+#include "Hunk.hpp"
+#include "HunkMap.hpp"
+#include "HunkPlanner.hpp"
+#include "IPSIndex.hpp"
+#include "Scan.hpp"
+#include "Sha256.hpp"
+#include "StreamReader.hpp"
+#include "UPS.hpp"
+#include "WorkPool.hpp"
+#include "XXHash64.hpp"
+
+//! @brief Base header for every IPS patch, translates literally to "PATCH".
+static const u8 sMagicHeader[] = {0x50, 0x41, 0x54, 0x43, 0x48};
+
+//! @brief Header of an IPS32 patch, whose offsets take 4 bytes, translates literally to "IPS32".
+static const u8 sIPS32Header[] = {0x49, 0x50, 0x53, 0x33, 0x32};
+
+//! @brief Size of the header, the same for both.
+#define MAGIC_HEADER_LENGTH sizeof(sMagicHeader)
+
+//! @brief Ranges smaller than that aren't worth a thread of their own when creating a patch.
+#define CREATE_RANGE_MINIMUM (1 << 20)
+
+//! @brief Bytes of the previous target block kept when streaming, the planner never reads further back.
+#define STREAM_HISTORY_SIZE 8
+
+//! @brief Bytes of both files read at once when making a UPS patch.
+#define UPS_BLOCK_SIZE (1 << 20)
+
+//! @brief Bytes of the subject hashed at once when checking it against the expected checksums.
+#define VERIFY_BLOCK_SIZE (1 << 20)
+
+//! @brief A patch parsed once, and shared by every batched job applying it.
+struct ParsedPatch
+{
+    BigEdian file;
+    IPSIndex index;
+    MidIPS::Format format;
+    const u8 *whole;
+    size_t wholeSize;
+    std::vector<u8> wholeCopy;
+    MidIPS::Status status;
+    MidIPS::Report report;
+
+    ParsedPatch(const std::string &patchName) : file(patchName, std::ios::in | std::ios::binary), format(MidIPS::Format::IPS), whole(nullptr), wholeSize(0), status(MidIPS::Status::Ok)
+    {
+    }
+};
+
+//! @brief Hashes the bytes it's handed in order, with the hash a MidIPS::Checksum asks for.
+struct RunningChecksum
+{
+    MidIPS::Hash hash;
+    u32 crc;
+    XXHash64 xxh;
+
+    RunningChecksum(const MidIPS::Hash hash) : hash(hash), crc(0)
+    {
+    }
+
+    void update(const u8 *bytes, const size_t length)
+    {
+        if (hash == MidIPS::Hash::CRC32)
+            crc = crc32(bytes, length, crc);
+        else if (hash == MidIPS::Hash::XXH64)
+            xxh.update(bytes, length);
+    }
+
+    u64 value() const
+    {
+        return hash == MidIPS::Hash::CRC32 ? crc : xxh.digest();
+    }
+};
+
+/**
+ * @param report
+ * @param status
+ * @param detail
+ *
+ * @brief Fills report's detail, if there's a report.
+ *
+ * @returns status, so that it can be returned right away.
+ */
+static MidIPS::Status failWith(MidIPS::Report *report, const MidIPS::Status status, const std::string &detail)
+{
+    if (report != nullptr)
+        report->detail = detail;
+
+    return status;
+}
+
+/**
+ * @param file
+ * @param report
+ *
+ * @brief Checks file for errors, and reports
+ * them.
+ *
+ * @returns The file's status.
+ */
+static MidIPS::Status checkFile(const BigEdian *file, MidIPS::Report *report)
+{
+    if (file->good())
+        return MidIPS::Status::Ok;
+
+    return failWith(report, file->status(), file->error());
+}
+
+/**
+ * @param patch
+ * @param isIPS32
+ * @param report
+ *
+ * @brief Reads and checks the header, telling
+ * IPS32 patches from IPS ones.
+ */
+static MidIPS::Status checkHeader(BigEdian *patch, bool *isIPS32, MidIPS::Report *report)
+{
+    const u8 *header = patch->readBytes(MAGIC_HEADER_LENGTH);
+
+    if (header != nullptr && std::memcmp(header, sMagicHeader, MAGIC_HEADER_LENGTH) == 0)
+        *isIPS32 = false;
+    else if (header != nullptr && std::memcmp(header, sIPS32Header, MAGIC_HEADER_LENGTH) == 0)
+        *isIPS32 = true;
+    else
+        return failWith(report, MidIPS::Status::InvalidHeader, "The passed file is not a valid IPS Patch.");
+
+    return MidIPS::Status::Ok;
+}
+
+/**
+ * @param patch
+ * @param targetSize
+ * @param options
+ * @param report
+ *
+ * @brief Checks that the patch is complete and applies
+ * cleanly on a file of targetSize bytes.
+ *
+ * @details Only the Hunks' headers are read, so it's
+ * cheap enough to run before every apply.
+ */
+static MidIPS::Status validatePatch(BigEdian *patch, const size_t targetSize, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    IPSSummary summary;
+    bool isIPS32 = false;
+
+    if (checkHeader(patch, &isIPS32, report) != MidIPS::Status::Ok)
+        return MidIPS::Status::InvalidHeader;
+
+    const MidIPS::Status retVal = IPSIndex::validate(patch, targetSize, isIPS32, &summary);
+
+    if (report != nullptr)
+    {
+        report->hunkCount = summary.hunkCount;
+        report->byteCount = summary.byteCount;
+        report->outputSize = summary.outputSize;
+    }
+
+    if (retVal == MidIPS::Status::OffsetOutOfRange)
+        return failWith(report, retVal, summary.error);
+    if (retVal != MidIPS::Status::Ok)
+        return failWith(report, retVal, patch->error());
+
+    return retVal;
+}
+
+/**
+ * @param patch
+ * @param index
+ * @param options
+ * @param report
+ *
+ * @brief Checks the header, and parses the whole
+ * patch into index.
+ *
+ * @details Nothing gets written before the patch is
+ * known to be complete, a truncated patch leaves the
+ * subject as it was.
+ */
+static MidIPS::Status parsePatch(BigEdian *patch, IPSIndex *index, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    bool isIPS32 = false;
+
+    if (checkHeader(patch, &isIPS32, report) != MidIPS::Status::Ok)
+        return MidIPS::Status::InvalidHeader;
+
+    index->parse(patch, isIPS32);
+
+    if (checkFile(patch, report) != MidIPS::Status::Ok)
+        return patch->status();
+
+    for (size_t i = 0, max = index->hunkCount(); i < max; i++)
+    {
+        const Hunk current = index->hunk(i);
+
+        if (options.onHunk)
+            options.onHunk(current.offset(), current.size());
+    }
+
+    if (report != nullptr)
+        report->hunkCount = index->hunkCount();
+
+    return MidIPS::Status::Ok;
+}
+
+/**
+ * @param targetSize
+ * @param isIPS32
+ * @param report
+ *
+ * @brief Picks the IPS flavour for a patch making
+ * a file of targetSize bytes: IPS when its offsets
+ * fit in 3 bytes, IPS32 when they fit in 4.
+ *
+ * @returns InvalidArgument past 4 GiB, which
+ * no IPS flavour can address.
+ */
+static MidIPS::Status pickFlavour(const size_t targetSize, bool *isIPS32, MidIPS::Report *report)
+{
+    if (targetSize > Hunk::offsetLimit(true))
+        return failWith(report, MidIPS::Status::InvalidArgument, "IPS patches can't address files past 4 GiB, use BPS or UPS.");
+
+    *isIPS32 = targetSize > Hunk::offsetLimit(false);
+    return MidIPS::Status::Ok;
+}
+
+/**
+ * @param output
+ * @param isIPS32
+ *
+ * @brief Writes the IPS, or IPS32, header,
+ * whether or not there are changes.
+ */
+static void writeHeader(BigEdian *output, const bool isIPS32)
+{
+    output->writeBytes(isIPS32 ? sIPS32Header : sMagicHeader, MAGIC_HEADER_LENGTH);
+}
+
+/**
+ * @param hunk
+ * @param output
+ * @param isIPS32
+ * @param options
+ * @param report
+ *
+ * @brief Writes a planned Hunk into output.
+ */
+static void emitHunk(const Hunk &hunk, BigEdian *output, const bool isIPS32, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    if (hunk.isEmpty())
+        return;
+
+    hunk.asIPS(output, isIPS32);
+
+    if (report != nullptr)
+        report->hunkCount++;
+    if (options.onHunk)
+        options.onHunk(hunk.offset(), hunk.size());
+}
+
+/**
+ * @param target
+ * @param offset
+ * @param length
+ * @param bytes
+ *
+ * @brief Copies length bytes of target, from
+ * offset, into bytes, for the planner.
+ *
+ * @details Unless the target is mapped they're
+ * read again, and the target goes back to where
+ * the diff left it.
+ */
+static void readTarget(BigEdian *target, const size_t offset, const size_t length, u8 *bytes)
+{
+    if (target->isMapped())
+    {
+        std::memcpy(bytes, target->data() + offset, length);
+        return;
+    }
+
+    const size_t position = target->tell();
+
+    target->seek(offset);
+
+    const u8 *read = target->readBytes(length);
+
+    if (read != nullptr)
+        std::memcpy(bytes, read, length);
+
+    target->seek(position);
+}
+
+/**
+ * @param file
+ * @param copy
+ *
+ * @brief Gets the whole file at once, copying
+ * it into copy unless it's mapped.
+ */
+static const u8 *wholeFile(BigEdian *file, std::vector<u8> *copy)
+{
+    if (file->isMapped())
+        return file->data();
+
+    file->seek(0);
+
+    const u8 *bytes = file->readBytes(file->size());
+
+    if (bytes != nullptr)
+        copy->assign(bytes, bytes + file->size());
+
+    return copy->data();
+}
+
+/**
+ * @param patch
+ * @param patchSize
+ *
+ * @brief Tells a patch's format by its header,
+ * anything but BPS and UPS being taken as IPS.
+ */
+static MidIPS::Format formatOf(const u8 *patch, const size_t patchSize)
+{
+    if (isBPS(patch, patchSize))
+        return MidIPS::Format::BPS;
+    if (isUPS(patch, patchSize))
+        return MidIPS::Format::UPS;
+
+    return MidIPS::Format::IPS;
+}
+
+/**
+ * @param patch
+ *
+ * @brief Tells a patch file's format by
+ * its header, leaving it at its very start.
+ */
+static MidIPS::Format formatOf(BigEdian *patch)
+{
+    const size_t length = std::min(patch->size(), static_cast<size_t>(std::max(BPS_MAGIC_LENGTH, UPS_MAGIC_LENGTH)));
+    const u8 *header = patch->readBytes(length);
+
+    patch->seek(0);
+    return header != nullptr ? formatOf(header, length) : MidIPS::Format::IPS;
+}
+
+/**
+ * @param planner
+ * @param offset
+ * @param bytes
+ * @param length
+ *
+ * @brief Hands length differing bytes to
+ * planner, as Hunks as long as possible.
+ */
+static void pushRun(HunkPlanner *planner, const size_t offset, const u8 *bytes, const size_t length)
+{
+    for (size_t i = 0; i < length; i += U16_MAX)
+        planner->push(Hunk(offset + i, std::min(length - i, static_cast<size_t>(U16_MAX)), 0, bytes + i));
+}
+
+/**
+ * @param planner
+ * @param blockStart
+ * @param sourceBlock
+ * @param targetBlock
+ * @param commonLength
+ * @param targetLength
+ *
+ * @brief Hands every differing run of two lined up
+ * blocks to planner, along with whatever the target
+ * block has past the source block's end.
+ */
+static void pushBlock(HunkPlanner *planner, const size_t blockStart, const u8 *sourceBlock, const u8 *targetBlock, const size_t commonLength, const size_t targetLength)
+{
+    size_t position = 0;
+
+    while (position < commonLength)
+    {
+        position += findMismatch(sourceBlock + position, targetBlock + position, commonLength - position);
+
+        if (position == commonLength)
+            break;
+
+        const size_t runEnd = position + findMatch(sourceBlock + position, targetBlock + position, commonLength - position);
+
+        pushRun(planner, blockStart + position, targetBlock + position, runEnd - position);
+        position = runEnd;
+    }
+
+    // The target goes on past the source's end.
+    pushRun(planner, blockStart + commonLength, targetBlock + commonLength, targetLength - commonLength);
+}
+
+/**
+ * @param planner
+ * @param output
+ * @param targetSize
+ * @param isShrunk
+ * @param isIPS32
+ *
+ * @brief Writes the last planned Hunks, and ends
+ * the patch with the "EOF" marker, or "EEOF" for
+ * IPS32, along with the size to truncate to if the
+ * target is the smaller one.
+ */
+static void endPatch(HunkPlanner *planner, BigEdian *output, const size_t targetSize, const bool isShrunk, const bool isIPS32)
+{
+    planner->finish();
+
+    if (isIPS32)
+        output->writeU32(IPS32_END_MARKER);
+    else
+        output->writeU24(IPS_END_MARKER);
+
+    if (isShrunk && isIPS32)
+        output->writeU32(targetSize);
+    else if (isShrunk)
+        output->writeU24(targetSize);
+
+    // Making sure the changes are actually written.
+    output->flush();
+}
+
+/**
+ * @param index
+ * @param destination
+ * @param undo
+ * @param options
+ * @param report
+ *
+ * @brief Applies an already parsed patch
+ * into destination.
+ *
+ * @details If there's an undo file, the original bytes
+ * are read right before being overwritten, and planned
+ * into an IPS patch restoring destination as it was.
+ */
+static MidIPS::Status applyIndex(const IPSIndex *index, BigEdian *destination, BigEdian *undo, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    IPSResolution resolution;
+    const size_t originalSize = destination->size();
+    MidIPS::Options undoOptions = options;
+    std::function<void(const Hunk &)> onOverwrite;
+    bool isUndoIPS32 = false;
+
+    // The undo patch makes the original file again.
+    if (undo != nullptr && pickFlavour(originalSize, &isUndoIPS32, report) != MidIPS::Status::Ok)
+        return MidIPS::Status::InvalidArgument;
+
+    // Only the patch being applied gets logged and counted.
+    undoOptions.onHunk = nullptr;
+
+    HunkPlanner undoPlanner = {[destination](size_t offset, size_t length, u8 *bytes)
+                               { readTarget(destination, offset, length, bytes); },
+                               [undo, isUndoIPS32, &undoOptions](const Hunk &planned)
+                               { emitHunk(planned, undo, isUndoIPS32, undoOptions, nullptr); },
+                               isUndoIPS32};
+
+    if (undo != nullptr)
+    {
+        writeHeader(undo, isUndoIPS32);
+        onOverwrite = [&undoPlanner](const Hunk &original)
+        { undoPlanner.push(original); };
+    }
+
+    const MidIPS::Status retVal = index->apply(destination, options.threadCount, &resolution, onOverwrite);
+
+    if (report != nullptr)
+    {
+        report->outputSize = destination->size();
+        report->byteCount = 0;
+
+        for (size_t i = 0, max = resolution.writes.size(); i < max; i++)
+            report->byteCount += resolution.writes[i].size();
+    }
+    if (retVal == MidIPS::Status::OffsetOutOfRange)
+        return failWith(report, retVal, resolution.error);
+    if (retVal != MidIPS::Status::Ok)
+        return failWith(report, retVal, destination->error());
+    if (undo == nullptr)
+        return retVal;
+
+    // The original size is restored if the file grew.
+    endPatch(&undoPlanner, undo, originalSize, destination->size() > originalSize, isUndoIPS32);
+    return checkFile(undo, report);
+}
+
+/**
+ * @param source
+ * @param target
+ * @param output
+ * @param report
+ *
+ * @brief Writes a BPS patch turning source
+ * into target into output.
+ */
+static MidIPS::Status createBPSPatch(BigEdian *source, BigEdian *target, BigEdian *output, MidIPS::Report *report)
+{
+    std::vector<u8> sourceCopy;
+    std::vector<u8> targetCopy;
+    const u8 *sourceData = wholeFile(source, &sourceCopy);
+    const u8 *targetData = wholeFile(target, &targetCopy);
+
+    if (checkFile(source, report) != MidIPS::Status::Ok)
+        return source->status();
+    if (checkFile(target, report) != MidIPS::Status::Ok)
+        return target->status();
+
+    const size_t actionCount = createBPS(sourceData, source->size(), targetData, target->size(), output);
+
+    if (report != nullptr)
+    {
+        report->hunkCount = actionCount;
+        report->outputSize = target->size();
+    }
+
+    return checkFile(output, report);
+}
+
+/**
+ * @param patch
+ * @param patchSize
+ * @param subject
+ * @param target
+ * @param report
+ *
+ * @brief Applies the BPS patch on subject, into target.
+ */
+static MidIPS::Status applyBPSPatch(const u8 *patch, const size_t patchSize, BigEdian *subject, std::vector<u8> *target, MidIPS::Report *report)
+{
+    std::vector<u8> subjectCopy;
+    std::string error;
+    size_t actionCount = 0;
+    const u8 *source = wholeFile(subject, &subjectCopy);
+
+    if (checkFile(subject, report) != MidIPS::Status::Ok)
+        return subject->status();
+
+    const MidIPS::Status retVal = applyBPS(patch, patchSize, source, subject->size(), target, &actionCount, &error);
+
+    if (retVal != MidIPS::Status::Ok)
+        return failWith(report, retVal, error);
+
+    if (report != nullptr)
+    {
+        report->hunkCount = actionCount;
+        report->byteCount = target->size();
+        report->outputSize = target->size();
+    }
+
+    return retVal;
+}
+
+/**
+ * @param encoder
+ * @param output
+ * @param targetSize
+ * @param report
+ *
+ * @brief Writes the UPS patch encoder made, once
+ * both files went through it, into output.
+ */
+static MidIPS::Status endUPSPatch(UPSEncoder *encoder, BigEdian *output, const size_t targetSize, MidIPS::Report *report)
+{
+    encoder->finish(output);
+
+    if (report != nullptr)
+    {
+        report->hunkCount = encoder->recordCount();
+        report->byteCount = encoder->byteCount();
+        report->outputSize = targetSize;
+    }
+
+    return checkFile(output, report);
+}
+
+/**
+ * @param source
+ * @param target
+ * @param output
+ * @param report
+ *
+ * @brief Writes a UPS patch turning source
+ * into target into output.
+ *
+ * @details Both files are read once, block by
+ * block, their checksums being computed along
+ * with the diff rather than in a pass of their own.
+ */
+static MidIPS::Status createUPSPatch(BigEdian *source, BigEdian *target, BigEdian *output, MidIPS::Report *report)
+{
+    UPSEncoder encoder;
+    const size_t sourceSize = source->size();
+    const size_t targetSize = target->size();
+
+    source->seek(0);
+    target->seek(0);
+
+    for (size_t offset = 0, max = std::max(sourceSize, targetSize); offset < max; offset += UPS_BLOCK_SIZE)
+    {
+        const size_t sourceLength = offset < sourceSize ? std::min(sourceSize - offset, static_cast<size_t>(UPS_BLOCK_SIZE)) : 0;
+        const size_t targetLength = offset < targetSize ? std::min(targetSize - offset, static_cast<size_t>(UPS_BLOCK_SIZE)) : 0;
+        const u8 *sourceBlock = sourceLength > 0 ? source->readBytes(sourceLength) : nullptr;
+        const u8 *targetBlock = targetLength > 0 ? target->readBytes(targetLength) : nullptr;
+
+        if (checkFile(source, report) != MidIPS::Status::Ok)
+            return source->status();
+        if (checkFile(target, report) != MidIPS::Status::Ok)
+            return target->status();
+
+        encoder.push(sourceBlock, sourceLength, targetBlock, targetLength);
+    }
+
+    return endUPSPatch(&encoder, output, targetSize, report);
+}
+
+/**
+ * @param source
+ * @param target
+ * @param output
+ * @param report
+ *
+ * @brief Same as createUPSPatch(), when one of
+ * the files can only be read once.
+ */
+static MidIPS::Status createUPSStream(StreamReader *source, StreamReader *target, BigEdian *output, MidIPS::Report *report)
+{
+    UPSEncoder encoder;
+    size_t sourceLength = 0;
+    size_t targetLength = 0;
+    size_t targetSize = 0;
+    const u8 *sourceBlock = source->next(&sourceLength);
+    const u8 *targetBlock = target->next(&targetLength);
+
+    while (sourceLength > 0 || targetLength > 0)
+    {
+        encoder.push(sourceBlock, sourceLength, targetBlock, targetLength);
+        targetSize += targetLength;
+
+        if (sourceLength > 0)
+            sourceBlock = source->next(&sourceLength);
+        if (targetLength > 0)
+            targetBlock = target->next(&targetLength);
+    }
+
+    if (!source->good())
+        return failWith(report, source->status(), source->error());
+    if (!target->good())
+        return failWith(report, target->status(), target->error());
+
+    return endUPSPatch(&encoder, output, targetSize, report);
+}
+
+/**
+ * @param patch
+ * @param patchSize
+ * @param subject
+ * @param onWrite
+ * @param targetSize
+ * @param report
+ *
+ * @brief Applies the UPS patch on subject, handing the
+ * target's differing bytes to onWrite, or only checks
+ * it without onWrite. The target's size, that subject
+ * has to be resized to, ends up in targetSize.
+ */
+static MidIPS::Status applyUPSPatch(const u8 *patch, const size_t patchSize, BigEdian *subject, const std::function<void(size_t, const u8 *, size_t)> &onWrite, size_t *targetSize, MidIPS::Report *report)
+{
+    std::vector<u8> subjectCopy;
+    UPSSummary summary;
+    const u8 *source = wholeFile(subject, &subjectCopy);
+
+    if (checkFile(subject, report) != MidIPS::Status::Ok)
+        return subject->status();
+
+    const MidIPS::Status retVal = applyUPS(patch, patchSize, source, subject->size(), onWrite, &summary);
+
+    if (retVal != MidIPS::Status::Ok)
+        return failWith(report, retVal, summary.error);
+
+    *targetSize = summary.targetSize;
+
+    if (report != nullptr)
+    {
+        report->hunkCount = summary.recordCount;
+        report->byteCount = summary.byteCount;
+        report->outputSize = summary.targetSize;
+    }
+
+    return retVal;
+}
+
+/**
+ * @param sourceData
+ * @param sourceSize
+ * @param targetData
+ * @param targetSize
+ * @param start
+ * @param stop
+ * @param hunks
+ *
+ * @brief Collects the Hunks of every differing run
+ * starting within [start, stop).
+ *
+ * @details That's what each thread runs. A run going on
+ * from the previous range belongs to it, and a run going
+ * on past stop is followed to its end, so every run is
+ * found by exactly one range, and split into Hunks from
+ * its very start just like the sequential diff does.
+ */
+static void diffRange(const u8 *sourceData, const size_t sourceSize, const u8 *targetData, const size_t targetSize, const size_t start, const size_t stop, std::vector<Hunk> *hunks)
+{
+    BigEdian source = {sourceData, sourceSize};
+    BigEdian target = {targetData, targetSize};
+    const size_t end = std::min(sourceSize, targetSize);
+    size_t position = start;
+
+    if (start > 0 && sourceData[start - 1] != targetData[start - 1])
+        position += findMatch(sourceData + start, targetData + start, end - start);
+
+    while (position < stop)
+    {
+        position += findMismatch(sourceData + position, targetData + position, stop - position);
+
+        if (position == stop)
+            break;
+
+        const size_t runEnd = position + findMatch(sourceData + position, targetData + position, end - position);
+
+        source.seek(position);
+        target.seek(position);
+
+        // The Hunks point into the target, no need for an Arena.
+        while (source.tell() < runEnd)
+            hunks->push_back(Hunk::fromDiff(&source, &target, nullptr));
+
+        position = runEnd;
+    }
+}
+
+/**
+ * @param source
+ * @param target
+ * @param planner
+ * @param options
+ *
+ * @brief Diffs both mapped files on several threads,
+ * and hands the Hunks to planner.
+ *
+ * @details Both files are split into consecutive ranges,
+ * one per thread, and the Hunks are then planned in
+ * order, so the patch is byte for byte the one the
+ * sequential diff makes.
+ */
+static void createParallel(BigEdian *source, BigEdian *target, HunkPlanner *planner, const MidIPS::Options &options)
+{
+    const size_t end = std::min(source->size(), target->size());
+    const size_t rangeCount = std::max(static_cast<size_t>(1), std::min(options.threadCount, end / CREATE_RANGE_MINIMUM));
+    const size_t rangeSize = end / rangeCount;
+    std::vector<std::vector<Hunk>> hunks(rangeCount);
+    std::vector<std::thread> workers;
+
+    for (size_t i = 0; i < rangeCount; i++)
+    {
+        const size_t start = i * rangeSize;
+        const size_t stop = i + 1 == rangeCount ? end : start + rangeSize;
+
+        workers.push_back(std::thread(diffRange, source->data(), source->size(), target->data(), target->size(), start, stop, &hunks[i]));
+    }
+
+    for (size_t i = 0; i < rangeCount; i++)
+    {
+        workers[i].join();
+
+        for (size_t j = 0, max = hunks[i].size(); j < max; j++)
+            planner->push(hunks[i][j]);
+    }
+
+    source->seek(end);
+    target->seek(end);
+}
+
+/**
+ * @param source
+ * @param target
+ * @param output
+ * @param options
+ * @param report
+ *
+ * @brief Writes an IPS patch turning source
+ * into target into output.
+ *
+ * @details It will parse the differences one by
+ * one, and plan them into the cheapest Hunks before
+ * writing them into output. With more than one thread
+ * and both files mapped, the diff runs on several
+ * ranges at once. Whatever the target has past the
+ * source's end follows, and the patch ends with the
+ * "EOF" marker, along with the size to truncate to if
+ * the target is the smaller one.
+ */
+static MidIPS::Status createPatch(BigEdian *source, BigEdian *target, BigEdian *output, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    // Holds the differing bytes when they can't be pointed to
+    // directly, it's reused from one Hunk to the next.
+    Arena diffArena;
+    bool isIPS32 = false;
+
+    if (pickFlavour(target->size(), &isIPS32, report) != MidIPS::Status::Ok)
+        return MidIPS::Status::InvalidArgument;
+
+    HunkPlanner planner = {[target](size_t offset, size_t length, u8 *bytes)
+                           { readTarget(target, offset, length, bytes); },
+                           [output, isIPS32, &options, report](const Hunk &planned)
+                           { emitHunk(planned, output, isIPS32, options, report); },
+                           isIPS32};
+
+    writeHeader(output, isIPS32);
+
+    if (options.threadCount > 1 && source->isMapped() && target->isMapped())
+        createParallel(source, target, &planner, options);
+
+    // Looping until we reach the end of one of the files.
+    while (!source->isEnd() && !target->isEnd())
+    {
+        planner.push(Hunk::fromDiff(source, target, &diffArena));
+        diffArena.reset();
+    }
+
+    // Streaming the target's tail, the planner turns it into
+    // literal and RLE Hunks just like the differing runs.
+    while (!target->isEnd())
+    {
+        const size_t offset = target->tell();
+        const u16 length = std::min(target->size() - offset, static_cast<size_t>(U16_MAX));
+        const u8 *tail = target->readBytes(length);
+
+        if (tail == nullptr)
+            break;
+        // The planner may read the target again before taking a copy.
+        if (!target->isMapped())
+            tail = diffArena.store(tail, length);
+
+        planner.push(Hunk(offset, length, 0, tail));
+        diffArena.reset();
+    }
+
+    endPatch(&planner, output, target->size(), target->size() < source->size(), isIPS32);
+
+    if (checkFile(source, report) != MidIPS::Status::Ok)
+        return source->status();
+    if (checkFile(target, report) != MidIPS::Status::Ok)
+        return target->status();
+
+    return checkFile(output, report);
+}
+
+/**
+ * @param source
+ * @param target
+ * @param index
+ * @param output
+ * @param options
+ * @param report
+ *
+ * @brief Same as createPatch(), but the source is
+ * only read where the index says it differs.
+ *
+ * @details Each block of the target gets hashed, and
+ * compared with the hash of the source block at the same
+ * offset. Only the blocks that don't match are read from
+ * the source and diffed byte by byte, so diffing many
+ * targets against one large base mostly costs hashing them.
+ */
+static MidIPS::Status createIndexed(BigEdian *source, BigEdian *target, const BlockIndex *index, BigEdian *output, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    const size_t blockSize = index->blockSize();
+    const size_t sourceSize = source->size();
+    std::vector<u8> blockCopy;
+    u8 digest[SHA256_SIZE];
+    bool isIPS32 = false;
+
+    if (pickFlavour(target->size(), &isIPS32, report) != MidIPS::Status::Ok)
+        return MidIPS::Status::InvalidArgument;
+
+    HunkPlanner planner = {[target](size_t offset, size_t length, u8 *bytes)
+                           { readTarget(target, offset, length, bytes); },
+                           [output, isIPS32, &options, report](const Hunk &planned)
+                           { emitHunk(planned, output, isIPS32, options, report); },
+                           isIPS32};
+
+    writeHeader(output, isIPS32);
+
+    while (!target->isEnd())
+    {
+        const size_t blockStart = target->tell();
+        const size_t targetLength = std::min(target->size() - blockStart, blockSize);
+        const size_t sourceLength = blockStart < sourceSize ? std::min(sourceSize - blockStart, blockSize) : 0;
+        const u8 *targetBlock = target->readBytes(targetLength);
+
+        if (targetBlock == nullptr)
+            break;
+
+        if (sourceLength == targetLength)
+        {
+            sha256(targetBlock, targetLength, digest);
+
+            if (std::memcmp(digest, index->hash(blockStart / blockSize), SHA256_SIZE) == 0)
+                continue;
+        }
+
+        // The planner may read the target again before taking a copy.
+        if (!target->isMapped())
+        {
+            blockCopy.assign(targetBlock, targetBlock + targetLength);
+            targetBlock = blockCopy.data();
+        }
+
+        const size_t commonLength = std::min(sourceLength, targetLength);
+        const u8 *sourceBlock = nullptr;
+
+        if (commonLength > 0)
+        {
+            source->seek(blockStart);
+            sourceBlock = source->readBytes(commonLength);
+
+            if (sourceBlock == nullptr)
+                break;
+        }
+
+        pushBlock(&planner, blockStart, sourceBlock, targetBlock, commonLength, targetLength);
+    }
+
+    endPatch(&planner, output, target->size(), target->size() < sourceSize, isIPS32);
+
+    if (checkFile(source, report) != MidIPS::Status::Ok)
+        return source->status();
+    if (checkFile(target, report) != MidIPS::Status::Ok)
+        return target->status();
+
+    return checkFile(output, report);
+}
+
+/**
+ * @param source
+ * @param target
+ * @param output
+ * @param options
+ * @param report
+ *
+ * @brief Same as createPatch(), but both files are
+ * read once from start to end, block by block.
+ *
+ * @details Blocks of both files line up, as only the
+ * last one can be short. The next blocks get read while
+ * the current ones are diffed, and only the last few
+ * bytes of the previous target block are kept, for the
+ * planner, so memory doesn't depend on the files' size.
+ * As the target's size isn't known upfront, the patch
+ * always is IPS32, and it fails past 4 GiB.
+ */
+static MidIPS::Status createStream(StreamReader *source, StreamReader *target, BigEdian *output, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    u8 history[STREAM_HISTORY_SIZE] = {0};
+    size_t blockStart = 0;
+    size_t sourceLength = 0;
+    size_t targetLength = 0;
+    const u8 *sourceBlock = source->next(&sourceLength);
+    const u8 *targetBlock = target->next(&targetLength);
+
+    HunkPlanner planner = {[&](size_t offset, size_t length, u8 *bytes)
+                           {
+                               for (size_t i = offset; i < offset + length; i++)
+                                   *bytes++ = i >= blockStart ? targetBlock[i - blockStart] : history[STREAM_HISTORY_SIZE - (blockStart - i)];
+                           },
+                           [output, &options, report](const Hunk &planned)
+                           { emitHunk(planned, output, true, options, report); },
+                           true};
+
+    writeHeader(output, true);
+
+    while (targetLength > 0)
+    {
+        if (blockStart + targetLength > Hunk::offsetLimit(true))
+            return failWith(report, MidIPS::Status::InvalidArgument, "IPS patches can't address files past 4 GiB, use BPS or UPS.");
+
+        pushBlock(&planner, blockStart, sourceBlock, targetBlock, std::min(sourceLength, targetLength), targetLength);
+
+        if (targetLength >= STREAM_HISTORY_SIZE)
+            std::memcpy(history, targetBlock + targetLength - STREAM_HISTORY_SIZE, STREAM_HISTORY_SIZE);
+
+        blockStart += targetLength;
+
+        // The target is over, and the source goes on.
+        if (sourceLength > targetLength)
+            break;
+        if (sourceLength > 0)
+            sourceBlock = source->next(&sourceLength);
+
+        targetBlock = target->next(&targetLength);
+    }
+
+    // The source has more than the target when it isn't over.
+    endPatch(&planner, output, blockStart, sourceLength > 0, true);
+
+    if (!source->good())
+        return failWith(report, source->status(), source->error());
+    if (!target->good())
+        return failWith(report, target->status(), target->error());
+
+    return checkFile(output, report);
+}
+
+/**
+ * @param options
+ *
+ * @brief Tells whether any checksum is expected.
+ */
+static bool hasChecksums(const MidIPS::Options &options)
+{
+    return options.sourceChecksum.hash != MidIPS::Hash::None || options.outputChecksum.hash != MidIPS::Hash::None;
+}
+
+/**
+ * @param hash
+ * @param value
+ *
+ * @brief Writes a checksum the way --source-hash
+ * and --output-hash take it, e.g. "crc32:1a2b3c4d".
+ */
+static std::string checksumText(const MidIPS::Hash hash, const u64 value)
+{
+    char text[32];
+
+    if (hash == MidIPS::Hash::CRC32)
+        std::snprintf(text, sizeof(text), "crc32:%08llx", static_cast<unsigned long long>(value));
+    else
+        std::snprintf(text, sizeof(text), "xxh64:%016llx", static_cast<unsigned long long>(value));
+
+    return text;
+}
+
+/**
+ * @param source
+ * @param output
+ * @param options
+ * @param report
+ *
+ * @brief Compares what source and output hashed
+ * to the checksums options expects.
+ */
+static MidIPS::Status compareChecksums(const RunningChecksum &source, const RunningChecksum &output, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    if (options.sourceChecksum.hash != MidIPS::Hash::None && source.value() != options.sourceChecksum.value)
+        return failWith(report, MidIPS::Status::ChecksumMismatch, "The file isn't the expected source, its checksum is " + checksumText(source.hash, source.value()) + ".");
+    if (options.outputChecksum.hash != MidIPS::Hash::None && output.value() != options.outputChecksum.value)
+        return failWith(report, MidIPS::Status::ChecksumMismatch, "The patched file wouldn't be the expected one, its checksum would be " + checksumText(output.hash, output.value()) + ".");
+
+    return MidIPS::Status::Ok;
+}
+
+/**
+ * @param source
+ * @param sourceSize
+ * @param output
+ * @param outputSize
+ * @param options
+ * @param report
+ *
+ * @brief Checks a source and its patched
+ * output, both in memory, against the
+ * checksums options expects.
+ */
+static MidIPS::Status verifyWhole(const u8 *source, const size_t sourceSize, const u8 *output, const size_t outputSize, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    RunningChecksum sourceChecksum = {options.sourceChecksum.hash};
+    RunningChecksum outputChecksum = {options.outputChecksum.hash};
+
+    sourceChecksum.update(source, sourceSize);
+    outputChecksum.update(output, outputSize);
+
+    return compareChecksums(sourceChecksum, outputChecksum, options, report);
+}
+
+/**
+ * @param index
+ * @param subject
+ * @param options
+ * @param report
+ *
+ * @brief Checks the subject, and the file the patch would
+ * make of it, against the checksums options expects,
+ * without writing anything.
+ *
+ * @details Both get hashed in a single pass over the
+ * subject, a block at a time: the source from its bytes,
+ * the output from the same bytes with the resolved writes
+ * laid over them, cut to the final size. Applying the
+ * writes never reads the subject, so that's the only read
+ * verifying costs, and as it's done before anything is
+ * written, a mismatch leaves nothing to roll back.
+ */
+static MidIPS::Status verifyIndex(const IPSIndex *index, BigEdian *subject, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    IPSResolution resolution;
+    const size_t originalSize = subject->size();
+    const MidIPS::Status resolved = index->resolve(originalSize, &resolution);
+
+    if (resolved != MidIPS::Status::Ok)
+        return failWith(report, resolved, resolution.error);
+
+    const size_t finalSize = index->finalSize(resolution);
+    const std::vector<Hunk> &writes = resolution.writes;
+    RunningChecksum source = {options.sourceChecksum.hash};
+    RunningChecksum output = {options.outputChecksum.hash};
+    std::vector<u8> block(VERIFY_BLOCK_SIZE);
+    size_t next = 0;
+
+    subject->seek(0);
+
+    for (size_t start = 0, end = std::max(originalSize, finalSize); start < end; start += VERIFY_BLOCK_SIZE)
+    {
+        const size_t length = std::min(end - start, static_cast<size_t>(VERIFY_BLOCK_SIZE));
+        const size_t originalLength = start < originalSize ? std::min(length, originalSize - start) : 0;
+        const u8 *original = originalLength > 0 ? subject->readBytes(originalLength) : nullptr;
+
+        if (checkFile(subject, report) != MidIPS::Status::Ok)
+            return subject->status();
+
+        source.update(original, originalLength);
+
+        if (output.hash == MidIPS::Hash::None || start >= finalSize)
+            continue;
+
+        // The file only grows through writes, the rest of the block is theirs.
+        std::memcpy(block.data(), original, originalLength);
+
+        while (next < writes.size() && writes[next].offset() + writes[next].size() <= start)
+            next++;
+
+        for (size_t i = next; i < writes.size() && writes[i].offset() < start + length; i++)
+        {
+            const Hunk &write = writes[i];
+            const size_t from = std::max(static_cast<size_t>(write.offset()), start);
+            const size_t to = std::min(write.offset() + write.size(), start + length);
+
+            if (write.length() > 0)
+                std::memcpy(block.data() + from - start, write.bytes() + from - write.offset(), to - from);
+            else
+                std::memset(block.data() + from - start, write.bytes()[0], to - from);
+        }
+
+        output.update(block.data(), std::min(length, finalSize - start));
+    }
+
+    return compareChecksums(source, output, options, report);
+}
+
+/**
+ * @param source
+ * @param sourceSize
+ * @param patch
+ * @param patchSize
+ * @param output
+ * @param options
+ * @param report
+ *
+ * @brief Applies the IPS patch on a copy of source,
+ * all of it in memory.
+ *
+ * @returns Ok, or what went wrong, output is only
+ * meaningful in the first case.
+ */
+MidIPS::Status MidIPS::apply(const u8 *source, const size_t sourceSize, const u8 *patch, const size_t patchSize, std::vector<u8> &output, const Options &options, Report *report)
+{
+    BigEdian patchFile = {patch, patchSize};
+    IPSIndex index;
+
+    if (options.threadCount == 0)
+        return failWith(report, Status::InvalidArgument, "Invalid thread count.");
+
+    Status applied = Status::Ok;
+
+    if (formatOf(patch, patchSize) == Format::BPS)
+    {
+        BigEdian sourceFile = {source, sourceSize};
+        applied = applyBPSPatch(patch, patchSize, &sourceFile, &output, report);
+    }
+    else if (formatOf(patch, patchSize) == Format::UPS)
+    {
+        BigEdian sourceFile = {source, sourceSize};
+        size_t targetSize = 0;
+
+        output.assign(source, source + sourceSize);
+
+        applied = applyUPSPatch(patch, patchSize, &sourceFile, [&output](size_t offset, const u8 *bytes, size_t length)
+                                             {
+                                                 if (offset + length > output.size())
+                                                     output.resize(offset + length);
+
+                                                 std::memcpy(output.data() + offset, bytes, length); },
+                                             &targetSize, report);
+
+        if (applied == Status::Ok)
+            output.resize(targetSize);
+    }
+    else if ((applied = parsePatch(&patchFile, &index, options, report)) == Status::Ok)
+    {
+        output.assign(source, source + sourceSize);
+
+        BigEdian destination = {&output};
+        applied = applyIndex(&index, &destination, nullptr, options, report);
+    }
+
+    if (applied != Status::Ok || !hasChecksums(options))
+        return applied;
+
+    return verifyWhole(source, sourceSize, output.data(), output.size(), options, report);
+}
+
+/**
+ * @param source
+ * @param sourceSize
+ * @param target
+ * @param targetSize
+ * @param patch
+ * @param options
+ * @param report
+ *
+ * @brief Creates an IPS patch turning source
+ * into target, all of it in memory.
+ */
+MidIPS::Status MidIPS::create(const u8 *source, const size_t sourceSize, const u8 *target, const size_t targetSize, std::vector<u8> &patch, const Options &options, Report *report)
+{
+    BigEdian sourceFile = {source, sourceSize};
+    BigEdian targetFile = {target, targetSize};
+
+    if (options.threadCount == 0)
+        return failWith(report, Status::InvalidArgument, "Invalid thread count.");
+
+    patch.clear();
+
+    BigEdian patchFile = {&patch};
+
+    if (options.format == Format::BPS)
+        return createBPSPatch(&sourceFile, &targetFile, &patchFile, report);
+    if (options.format == Format::UPS)
+        return createUPSPatch(&sourceFile, &targetFile, &patchFile, report);
+
+    return createPatch(&sourceFile, &targetFile, &patchFile, options, report);
+}
+
+/**
+ * @param patch
+ * @param patchSize
+ * @param targetSize
+ * @param options
+ * @param report
+ *
+ * @brief Checks that the IPS patch is complete and
+ * applies cleanly on targetSize bytes, without applying it.
+ *
+ * @returns Ok, or what applying it would run into.
+ */
+MidIPS::Status MidIPS::validate(const u8 *patch, const size_t patchSize, const size_t targetSize, const Options &options, Report *report)
+{
+    BigEdian patchFile = {patch, patchSize};
+
+    return validatePatch(&patchFile, targetSize, options, report);
+}
+
+/**
+ * @param index
+ * @param subjectName
+ * @param outputName
+ * @param options
+ * @param report
+ *
+ * @brief Applies an already parsed patch on the
+ * subject, or on a copy of it into outputName.
+ *
+ * @details The subject is checked against the expected
+ * checksums first, if any. The undo patch, if any,
+ * gets written along the way.
+ */
+static MidIPS::Status applyParsed(const IPSIndex *index, const std::string &subjectName, const std::string &outputName, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    // Checked before the output is even made.
+    if (hasChecksums(options))
+    {
+        BigEdian subject = {subjectName, std::ios::in | std::ios::binary};
+
+        if (checkFile(&subject, report) != MidIPS::Status::Ok)
+            return subject.status();
+
+        const MidIPS::Status verified = verifyIndex(index, &subject, options, report);
+
+        if (verified != MidIPS::Status::Ok)
+            return verified;
+    }
+
+    // The output starts as a clone of the subject, which the
+    // kernel can usually make without copying the data.
+    if (!outputName.empty())
+    {
+        const MidIPS::Status cloned = BigEdian::clone(subjectName, outputName);
+
+        if (cloned != MidIPS::Status::Ok)
+            return failWith(report, cloned, "Unable to copy '" + subjectName + "' into '" + outputName + "'.");
+    }
+
+    BigEdian destination = {outputName.empty() ? subjectName : outputName, std::ios::in | std::ios::out | std::ios::binary};
+
+    if (checkFile(&destination, report) != MidIPS::Status::Ok)
+        return destination.status();
+    if (options.undoName.empty())
+        return applyIndex(index, &destination, nullptr, options, report);
+
+    BigEdian undo = {options.undoName, std::ios::out | std::ios::binary};
+
+    if (checkFile(&undo, report) != MidIPS::Status::Ok)
+        return undo.status();
+
+    return applyIndex(index, &destination, &undo, options, report);
+}
+
+/**
+ * @param patch
+ * @param patchSize
+ * @param subjectName
+ * @param outputName
+ * @param options
+ * @param report
+ *
+ * @brief Applies a BPS patch on the subject,
+ * or into outputName.
+ *
+ * @details The target is made in memory, as BPS
+ * copies may read any of it back, then written
+ * over the subject or into outputName.
+ */
+static MidIPS::Status applyBPSFile(const u8 *patch, const size_t patchSize, const std::string &subjectName, const std::string &outputName, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    std::vector<u8> target;
+
+    if (!options.undoName.empty())
+        return failWith(report, MidIPS::Status::InvalidArgument, "Undo patches can only be made while applying IPS patches.");
+
+    // The subject is let go of before being overwritten.
+    {
+        BigEdian subject = {subjectName, std::ios::in | std::ios::binary};
+        std::vector<u8> subjectCopy;
+        const u8 *source = wholeFile(&subject, &subjectCopy);
+
+        if (checkFile(&subject, report) != MidIPS::Status::Ok)
+            return subject.status();
+
+        BigEdian sourceView = {source, subject.size()};
+        const MidIPS::Status applied = applyBPSPatch(patch, patchSize, &sourceView, &target, report);
+
+        if (applied != MidIPS::Status::Ok)
+            return applied;
+        if (hasChecksums(options) && verifyWhole(source, subject.size(), target.data(), target.size(), options, report) != MidIPS::Status::Ok)
+            return MidIPS::Status::ChecksumMismatch;
+    }
+
+    BigEdian destination = {outputName.empty() ? subjectName : outputName, std::ios::out | std::ios::binary};
+
+    if (checkFile(&destination, report) != MidIPS::Status::Ok)
+        return destination.status();
+    if (!target.empty())
+        destination.writeBytes(target.data(), target.size());
+
+    destination.flush();
+    return checkFile(&destination, report);
+}
+
+/**
+ * @param patch
+ * @param patchSize
+ * @param subjectName
+ * @param outputName
+ * @param options
+ * @param report
+ *
+ * @brief Applies a UPS patch on the subject,
+ * or on a copy of it into outputName.
+ *
+ * @details The whole subject gets read once, to check it
+ * and the target against the patch's checksums, then only
+ * the differing bytes get written. The output is only
+ * cloned or written once both checksums match. Positional
+ * writes leave the file's state alone, so a failed one is
+ * kept aside, and the following ones are skipped.
+ */
+static MidIPS::Status applyUPSFile(const u8 *patch, const size_t patchSize, const std::string &subjectName, const std::string &outputName, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    std::unique_ptr<BigEdian> destination;
+    const std::string destinationName = outputName.empty() ? subjectName : outputName;
+    MidIPS::Status opened = MidIPS::Status::Ok;
+    size_t targetSize = 0;
+    bool isWritten = true;
+
+    if (!options.undoName.empty())
+        return failWith(report, MidIPS::Status::InvalidArgument, "Undo patches can only be made while applying IPS patches.");
+    if (hasChecksums(options))
+        return failWith(report, MidIPS::Status::InvalidArgument, "UPS patches are only checked against their own CRC32s.");
+
+    BigEdian subject = {subjectName, std::ios::in | std::ios::binary};
+
+    if (checkFile(&subject, report) != MidIPS::Status::Ok)
+        return subject.status();
+
+    // Only called once the checksums matched.
+    const auto open = [&]()
+    {
+        if (destination != nullptr || opened != MidIPS::Status::Ok)
+            return;
+        if (!outputName.empty() && (opened = BigEdian::clone(subjectName, outputName)) != MidIPS::Status::Ok)
+        {
+            failWith(report, opened, "Unable to copy '" + subjectName + "' into '" + outputName + "'.");
+            return;
+        }
+
+        destination.reset(new BigEdian(destinationName, std::ios::in | std::ios::out | std::ios::binary));
+        opened = checkFile(destination.get(), report);
+    };
+
+    const MidIPS::Status applied = applyUPSPatch(patch, patchSize, &subject, [&](size_t offset, const u8 *bytes, size_t length)
+                                                 {
+                                                     open();
+
+                                                     if (destination != nullptr && opened == MidIPS::Status::Ok && isWritten)
+                                                         isWritten = destination->writeAt(offset, bytes, length); },
+                                                 &targetSize, report);
+
+    if (applied != MidIPS::Status::Ok)
+        return applied;
+
+    open();
+
+    if (opened != MidIPS::Status::Ok)
+        return opened;
+    if (!isWritten)
+        return failWith(report, MidIPS::Status::WriteFailed, "Errors occurred while writing '" + destinationName + "'.");
+    if (targetSize != destination->size())
+        destination->resize(targetSize);
+
+    return checkFile(destination.get(), report);
+}
+
+/**
+ * @param format
+ * @param patch
+ * @param patchSize
+ * @param subjectName
+ * @param outputName
+ * @param options
+ * @param report
+ *
+ * @brief Applies a BPS or UPS patch, read whole.
+ */
+static MidIPS::Status applyWholeFile(const MidIPS::Format format, const u8 *patch, const size_t patchSize, const std::string &subjectName, const std::string &outputName, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    if (format == MidIPS::Format::UPS)
+        return applyUPSFile(patch, patchSize, subjectName, outputName, options, report);
+
+    return applyBPSFile(patch, patchSize, subjectName, outputName, options, report);
+}
+
+/**
+ * @param patchName
+ * @param subjectName
+ * @param outputName
+ * @param options
+ * @param report
+ *
+ * @brief Applies an IPS patch on a file.
+ *
+ * @details It will first parse the whole patch,
+ * and then apply each section of it. If outputName
+ * isn't empty, the subject is cloned into it first
+ * and left untouched. BPS patches are told apart
+ * by their header.
+ */
+MidIPS::Status MidIPS::applyFile(const std::string &patchName, const std::string &subjectName, const std::string &outputName, const Options &options, Report *report)
+{
+    BigEdian patchFile = {patchName, std::ios::in | std::ios::binary};
+    IPSIndex index;
+
+    if (options.threadCount == 0)
+        return failWith(report, Status::InvalidArgument, "Invalid thread count.");
+    if (checkFile(&patchFile, report) != Status::Ok)
+        return patchFile.status();
+
+    const Format format = formatOf(&patchFile);
+
+    if (format != Format::IPS)
+    {
+        std::vector<u8> patchCopy;
+        const u8 *patch = wholeFile(&patchFile, &patchCopy);
+
+        if (checkFile(&patchFile, report) != Status::Ok)
+            return patchFile.status();
+
+        return applyWholeFile(format, patch, patchFile.size(), subjectName, outputName, options, report);
+    }
+
+    const Status parsed = parsePatch(&patchFile, &index, options, report);
+
+    if (parsed != Status::Ok)
+        return parsed;
+
+    return applyParsed(&index, subjectName, outputName, options, report);
+}
+
+/**
+ * @param jobs
+ * @param options
+ * @param report
+ *
+ * @brief Applies every job's patch on its subject,
+ * on a pool of threads.
+ *
+ * @details Each distinct patch is parsed once, and shared
+ * by the jobs applying it, which then only resolve it
+ * against their own subject. Each job gets its own status
+ * and report, so a failing one doesn't stop the others.
+ *
+ * @returns Ok, or the status of the first job that failed.
+ */
+MidIPS::Status MidIPS::applyBatch(std::vector<ApplyJob> &jobs, const Options &options, Report *report)
+{
+    std::map<std::string, size_t> patchIds;
+    std::vector<std::string> patchNames;
+    std::vector<size_t> jobPatches;
+    MidIPS::Options jobOptions = options;
+
+    if (options.threadCount == 0)
+        return failWith(report, Status::InvalidArgument, "Invalid thread count.");
+    if (hasChecksums(options))
+        return failWith(report, Status::InvalidArgument, "Checksums are expected per file, not per batch.");
+
+    for (size_t i = 0, max = jobs.size(); i < max; i++)
+    {
+        const std::map<std::string, size_t>::iterator found = patchIds.insert(std::make_pair(jobs[i].patchName, patchNames.size())).first;
+
+        if (found->second == patchNames.size())
+            patchNames.push_back(jobs[i].patchName);
+
+        jobPatches.push_back(found->second);
+    }
+
+    std::vector<std::unique_ptr<ParsedPatch>> patches(patchNames.size());
+    WorkPool pool = {options.threadCount};
+
+    pool.run(patches.size(), [&](size_t i)
+             {
+                 patches[i].reset(new ParsedPatch(patchNames[i]));
+
+                 ParsedPatch &patch = *patches[i];
+
+                 if (checkFile(&patch.file, &patch.report) != Status::Ok)
+                     patch.status = patch.file.status();
+                 else if ((patch.format = formatOf(&patch.file)) == Format::IPS)
+                     patch.status = parsePatch(&patch.file, &patch.index, options, &patch.report);
+                 else if ((patch.whole = wholeFile(&patch.file, &patch.wholeCopy)) == nullptr || !patch.file.good())
+                     patch.status = failWith(&patch.report, patch.file.status(), patch.file.error());
+                 else
+                     patch.wholeSize = patch.file.size(); });
+
+    // The jobs would all write the same undo patch.
+    jobOptions.threadCount = 1;
+    jobOptions.undoName.clear();
+
+    pool.run(jobs.size(), [&](size_t i)
+             {
+                 ApplyJob &job = jobs[i];
+                 const ParsedPatch &patch = *patches[jobPatches[i]];
+
+                 job.report = patch.report;
+                 job.status = patch.status;
+
+                 if (job.status == Status::Ok && patch.format != Format::IPS)
+                     job.status = applyWholeFile(patch.format, patch.whole, patch.wholeSize, job.subjectName, job.outputName, jobOptions, &job.report);
+                 else if (job.status == Status::Ok)
+                     job.status = applyParsed(&patch.index, job.subjectName, job.outputName, jobOptions, &job.report); });
+
+    for (size_t i = 0, max = jobs.size(); i < max; i++)
+    {
+        if (jobs[i].status != Status::Ok)
+            return jobs[i].status;
+    }
+
+    return Status::Ok;
+}
+
+/**
+ * @param sourceName
+ * @param targetName
+ * @param patchName
+ * @param options
+ * @param report
+ *
+ * @brief Same as createFile(), when one of the files
+ * can only be read once, e.g. "-" or a named pipe.
+ */
+static MidIPS::Status createStreamFile(const std::string &sourceName, const std::string &targetName, const std::string &patchName, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    if (sourceName == "-" && targetName == "-")
+        return failWith(report, MidIPS::Status::InvalidArgument, "The source and the target can't both be read from stdin.");
+
+    StreamReader source = {sourceName};
+    StreamReader target = {targetName};
+
+    if (!source.good())
+        return failWith(report, source.status(), source.error());
+    if (!target.good())
+        return failWith(report, target.status(), target.error());
+
+    BigEdian patchFile = {patchName, std::ios::out | std::ios::binary};
+
+    if (checkFile(&patchFile, report) != MidIPS::Status::Ok)
+        return patchFile.status();
+    if (options.format == MidIPS::Format::UPS)
+        return createUPSStream(&source, &target, &patchFile, report);
+
+    return createStream(&source, &target, &patchFile, options, report);
+}
+
+/**
+ * @param index
+ * @param sourceName
+ * @param report
+ *
+ * @brief Checks that index could be loaded, and
+ * that it was built from sourceName as it is now.
+ */
+static MidIPS::Status checkIndex(const BlockIndex *index, const std::string &sourceName, MidIPS::Report *report)
+{
+    if (!index->good())
+        return failWith(report, index->status(), index->error());
+    if (!index->matches(sourceName))
+        return failWith(report, MidIPS::Status::InvalidArgument, "The index wasn't built from the source as it is now, rebuild it.");
+
+    return MidIPS::Status::Ok;
+}
+
+/**
+ * @param source
+ * @param index
+ * @param targetName
+ * @param patchName
+ * @param options
+ * @param report
+ *
+ * @brief Creates an IPS patch turning the already
+ * opened source into the target file.
+ *
+ * @details With an index, only the blocks whose
+ * hashes differ get diffed. BPS patches don't
+ * use it, their matches being searched anywhere,
+ * nor do UPS ones, which checksum every byte.
+ */
+static MidIPS::Status createJob(BigEdian *source, const BlockIndex *index, const std::string &targetName, const std::string &patchName, const MidIPS::Options &options, MidIPS::Report *report)
+{
+    BigEdian targetFile = {targetName, std::ios::in | std::ios::binary};
+
+    if (checkFile(&targetFile, report) != MidIPS::Status::Ok)
+        return targetFile.status();
+
+    BigEdian patchFile = {patchName, std::ios::out | std::ios::binary};
+
+    if (checkFile(&patchFile, report) != MidIPS::Status::Ok)
+        return patchFile.status();
+    if (options.format == MidIPS::Format::BPS)
+        return createBPSPatch(source, &targetFile, &patchFile, report);
+    if (options.format == MidIPS::Format::UPS)
+        return createUPSPatch(source, &targetFile, &patchFile, report);
+    if (index == nullptr)
+        return createPatch(source, &targetFile, &patchFile, options, report);
+
+    return createIndexed(source, &targetFile, index, &patchFile, options, report);
+}
+
+/**
+ * @param fileName
+ * @param bytes
+ * @param report
+ *
+ * @brief Reads the whole stream into bytes.
+ */
+static MidIPS::Status readStream(const std::string &fileName, std::vector<u8> *bytes, MidIPS::Report *report)
+{
+    StreamReader stream = {fileName};
+    size_t length = 0;
+
+    if (!stream.good())
+        return failWith(report, stream.status(), stream.error());
+
+    for (const u8 *block = stream.next(&length); length > 0; block = stream.next(&length))
+        bytes->insert(bytes->end(), block, block + length);
+
+    if (!stream.good())
+        return failWith(report, stream.status(), stream.error());
+
+    return MidIPS::Status::Ok;
+}
+
+/**
+ * @param sourceData
+ * @param sourceSize
+ * @param index
+ * @param jobs
+ * @param options
+ *
+ * @brief Runs every job on a pool of threads,
+ * all of them diffing against the same source.
+ *
+ * @details Each job gets a view of its own on the source,
+ * which is never copied. The jobs themselves run on one
+ * thread each, the pool being what runs them at once.
+ */
+static void runCreateJobs(const u8 *sourceData, const size_t sourceSize, const BlockIndex *index, std::vector<MidIPS::CreateJob> &jobs, const MidIPS::Options &options)
+{
+    WorkPool pool = {options.threadCount};
+    MidIPS::Options jobOptions = options;
+
+    jobOptions.threadCount = 1;
+
+    pool.run(jobs.size(), [&](size_t i)
+             {
+                 MidIPS::CreateJob &job = jobs[i];
+                 BigEdian source = {sourceData, sourceSize};
+
+                 if (StreamReader::isStream(job.targetName))
+                     job.status = failWith(&job.report, MidIPS::Status::InvalidArgument, "Batched targets can't be streamed.");
+                 else
+                     job.status = createJob(&source, index, job.targetName, job.patchName, jobOptions, &job.report); });
+}
+
+/**
+ * @param sourceName
+ * @param targetName
+ * @param patchName
+ * @param options
+ * @param report
+ *
+ * @brief Creates an IPS patch turning the
+ * source file into the target file.
+ *
+ * @details "-" and named pipes get streamed, and with
+ * an index of the source only the blocks whose hashes
+ * differ get diffed.
+ */
+MidIPS::Status MidIPS::createFile(const std::string &sourceName, const std::string &targetName, const std::string &patchName, const Options &options, Report *report)
+{
+    if (options.threadCount == 0)
+        return failWith(report, Status::InvalidArgument, "Invalid thread count.");
+    if ((StreamReader::isStream(sourceName) || StreamReader::isStream(targetName)) && options.format == Format::BPS)
+        return failWith(report, Status::InvalidArgument, "BPS patches can't be created from streams.");
+    if (StreamReader::isStream(sourceName) || StreamReader::isStream(targetName))
+        return createStreamFile(sourceName, targetName, patchName, options, report);
+
+    BigEdian sourceFile = {sourceName, std::ios::in | std::ios::binary};
+
+    if (checkFile(&sourceFile, report) != Status::Ok)
+        return sourceFile.status();
+    if (options.indexName.empty())
+        return createJob(&sourceFile, nullptr, targetName, patchName, options, report);
+
+    // Checking the index before the patch gets truncated.
+    const BlockIndex index = {options.indexName};
+    const Status status = checkIndex(&index, sourceName, report);
+
+    if (status != Status::Ok)
+        return status;
+
+    return createJob(&sourceFile, &index, targetName, patchName, options, report);
+}
+
+/**
+ * @param sourceName
+ * @param jobs
+ * @param options
+ * @param report
+ *
+ * @brief Creates an IPS patch for each job, all
+ * of them against the same source file.
+ *
+ * @details The source is read once, it's mapped or else
+ * loaded in memory, "-" and named pipes included, and
+ * shared by the threads running the jobs. Each job gets
+ * its own status and report, report only tells why the
+ * source couldn't be read.
+ *
+ * @returns Ok, or the status of the first job that failed.
+ */
+MidIPS::Status MidIPS::createBatch(const std::string &sourceName, std::vector<CreateJob> &jobs, const Options &options, Report *report)
+{
+    std::vector<u8> sourceCopy;
+    std::unique_ptr<BlockIndex> index;
+
+    if (options.threadCount == 0)
+        return failWith(report, Status::InvalidArgument, "Invalid thread count.");
+
+    if (!options.indexName.empty())
+    {
+        index.reset(new BlockIndex(options.indexName));
+
+        const Status status = checkIndex(index.get(), sourceName, report);
+
+        if (status != Status::Ok)
+            return status;
+    }
+
+    if (StreamReader::isStream(sourceName))
+    {
+        const Status status = readStream(sourceName, &sourceCopy, report);
+
+        if (status != Status::Ok)
+            return status;
+
+        runCreateJobs(sourceCopy.data(), sourceCopy.size(), index.get(), jobs, options);
+    }
+    else
+    {
+        BigEdian sourceFile = {sourceName, std::ios::in | std::ios::binary};
+
+        if (checkFile(&sourceFile, report) != Status::Ok)
+            return sourceFile.status();
+
+        const u8 *sourceData = wholeFile(&sourceFile, &sourceCopy);
+
+        if (checkFile(&sourceFile, report) != Status::Ok)
+            return sourceFile.status();
+
+        runCreateJobs(sourceData, sourceFile.size(), index.get(), jobs, options);
+    }
+
+    for (size_t i = 0, max = jobs.size(); i < max; i++)
+    {
+        if (jobs[i].status != Status::Ok)
+            return jobs[i].status;
+    }
+
+    return Status::Ok;
+}
+
+/**
+ * @param patchNames
+ * @param baseName
+ * @param patchName
+ * @param options
+ * @param report
+ *
+ * @brief Folds a chain of IPS patches, to be applied in
+ * order on the base file, into one equivalent patch.
+ *
+ * @details Each patch is resolved against the size the file
+ * has by then, and its writes go into an interval map, over
+ * the previous patches' ones, truncations dropping whatever
+ * lies past the new end. The map's Hunks are then planned
+ * like a diff's, so touching or close ones get coalesced,
+ * the base filling the gaps. Applying the result on the
+ * base gives the same bytes as applying the whole chain.
+ */
+MidIPS::Status MidIPS::squashFile(const std::vector<std::string> &patchNames, const std::string &baseName, const std::string &patchName, const Options &options, Report *report)
+{
+    BigEdian base = {baseName, std::ios::in | std::ios::binary};
+    std::vector<std::unique_ptr<ParsedPatch>> patches;
+    HunkMap squashed;
+
+    if (patchNames.empty())
+        return failWith(report, Status::InvalidArgument, "There's no patch to squash.");
+    if (checkFile(&base, report) != Status::Ok)
+        return base.status();
+
+    size_t size = base.size();
+
+    for (size_t i = 0, max = patchNames.size(); i < max; i++)
+    {
+        patches.push_back(std::unique_ptr<ParsedPatch>(new ParsedPatch(patchNames[i])));
+
+        ParsedPatch &patch = *patches.back();
+        IPSResolution resolution;
+        bool isIPS32 = false;
+
+        if (checkFile(&patch.file, report) != Status::Ok)
+            return patch.file.status();
+        if (checkHeader(&patch.file, &isIPS32, report) != Status::Ok)
+            return Status::InvalidHeader;
+
+        patch.index.parse(&patch.file, isIPS32);
+
+        if (checkFile(&patch.file, report) != Status::Ok)
+            return patch.file.status();
+
+        const Status resolved = patch.index.resolve(size, &resolution);
+
+        if (resolved != Status::Ok)
+            return failWith(report, resolved, patchNames[i] + ": " + resolution.error);
+
+        for (size_t j = 0, writeCount = resolution.writes.size(); j < writeCount; j++)
+            squashed.write(resolution.writes[j]);
+
+        size = resolution.resolvedSize;
+
+        if (patch.index.hasTruncate() && patch.index.truncateSize() < size)
+        {
+            size = patch.index.truncateSize();
+            squashed.truncate(size);
+        }
+    }
+
+    bool isIPS32 = false;
+
+    // The squashed patch's flavour only depends on the final size.
+    if (pickFlavour(size, &isIPS32, report) != Status::Ok)
+        return Status::InvalidArgument;
+
+    BigEdian output = {patchName, std::ios::out | std::ios::binary};
+
+    if (checkFile(&output, report) != Status::Ok)
+        return output.status();
+
+    HunkPlanner planner = {[&base, &squashed](size_t offset, size_t length, u8 *bytes)
+                           {
+                               for (size_t i = 0; i < length; i++)
+                               {
+                                   if (!squashed.byteAt(offset + i, bytes + i))
+                                       readTarget(&base, offset + i, 1, bytes + i);
+                               }
+                           },
+                           [&output, isIPS32, &options, report](const Hunk &planned)
+                           { emitHunk(planned, &output, isIPS32, options, report); },
+                           isIPS32};
+
+    writeHeader(&output, isIPS32);
+
+    for (std::map<size_t, Hunk>::const_iterator it = squashed.hunks().begin(); it != squashed.hunks().end(); it++)
+        planner.push(it->second);
+
+    endPatch(&planner, &output, size, size < base.size(), isIPS32);
+
+    if (report != nullptr)
+        report->outputSize = size;
+    if (checkFile(&base, report) != Status::Ok)
+        return base.status();
+
+    return checkFile(&output, report);
+}
+
+/**
+ * @param sourceName
+ * @param indexName
+ * @param report
+ *
+ * @brief Hashes the source file block by block into
+ * indexName, for createFile() to skip the blocks
+ * the target didn't change.
+ */
+MidIPS::Status MidIPS::indexFile(const std::string &sourceName, const std::string &indexName, Report *report)
+{
+    const Status status = BlockIndex::build(sourceName, indexName);
+
+    if (status != Status::Ok)
+        return failWith(report, status, "Couldn't index '" + sourceName + "' into '" + indexName + "'.");
+
+    return status;
+}
+
+/**
+ * @param patchName
+ * @param subjectName
+ * @param options
+ * @param report
+ *
+ * @brief Checks that the IPS patch is complete and
+ * applies cleanly on the subject, without touching it.
+ *
+ * @details With expected checksums, the subject and
+ * the file the patch would make are hashed too.
+ */
+MidIPS::Status MidIPS::validateFile(const std::string &patchName, const std::string &subjectName, const Options &options, Report *report)
+{
+    BigEdian patchFile = {patchName, std::ios::in | std::ios::binary};
+    BigEdian subject = {subjectName, std::ios::in | std::ios::binary};
+
+    if (checkFile(&patchFile, report) != Status::Ok)
+        return patchFile.status();
+    if (checkFile(&subject, report) != Status::Ok)
+        return subject.status();
+
+    const Format format = formatOf(&patchFile);
+
+    // A BPS patch is only checked by applying it in memory,
+    // a UPS one by checksumming what it would write.
+    if (format != Format::IPS)
+    {
+        std::vector<u8> patchCopy;
+        std::vector<u8> subjectCopy;
+        std::vector<u8> target;
+        size_t targetSize = 0;
+        const u8 *patch = wholeFile(&patchFile, &patchCopy);
+
+        if (checkFile(&patchFile, report) != Status::Ok)
+            return patchFile.status();
+        if (format == Format::UPS && hasChecksums(options))
+            return failWith(report, Status::InvalidArgument, "UPS patches are only checked against their own CRC32s.");
+        if (format == Format::UPS)
+            return applyUPSPatch(patch, patchFile.size(), &subject, nullptr, &targetSize, report);
+
+        const u8 *source = wholeFile(&subject, &subjectCopy);
+
+        if (checkFile(&subject, report) != Status::Ok)
+            return subject.status();
+
+        BigEdian sourceView = {source, subject.size()};
+        const Status applied = applyBPSPatch(patch, patchFile.size(), &sourceView, &target, report);
+
+        if (applied != Status::Ok || !hasChecksums(options))
+            return applied;
+
+        return verifyWhole(source, subject.size(), target.data(), target.size(), options, report);
+    }
+
+    const Status validated = validatePatch(&patchFile, subject.size(), options, report);
+
+    if (validated != Status::Ok || !hasChecksums(options))
+        return validated;
+
+    IPSIndex index;
+
+    patchFile.seek(0);
+
+    const Status parsed = parsePatch(&patchFile, &index, options, report);
+
+    if (parsed != Status::Ok)
+        return parsed;
+
+    return verifyIndex(&index, &subject, options, report);
+}
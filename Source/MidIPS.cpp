@@ -1,48 +1,17 @@
 #include <iostream>
 #include <fstream>
+#include <cstdlib>
 #include <cstring>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 #include "MidIPS.hpp"
-#include "BigEdian.hpp"
-#include "Hunk.hpp"
-
-//! @brief Computes the size of an array within the scope.
-#define ARRAY_COUNT(x) (sizeof(x) / sizeof(x)[0])
+#include "LibMidIPS.hpp"
 
 //! @brief Computes the max length of a char* buffer.
 #define MAX_BUFFER_LENGTH 500
 
-//! @brief Base header for every IPS patch, translates literally to "PATCH".
-const u8 gMagicHeader[] = {0x50, 0x41, 0x54, 0x43, 0x48};
-
-//! @brief Global size of the header.
-const size_t gMagicHeaderLength = ARRAY_COUNT(gMagicHeader);
-
-/**
- * @param bytes1
- * @param bytes2
- *
- * @brief Compares two u8 arrays.
- *
- * @returns If they're exactly the same or not.
- *
- * @warning Does *NOT* work like strcmp.
- *
- * @todo Maybe use a template instead ? Not exactly
- * useful though.
- */
-static bool areBytesEqual(const u8 *bytes1, const u8 *bytes2, const size_t &length)
-{
-    for (size_t i = 0; i < length; i++)
-    {
-        if (bytes1[i] != bytes2[i])
-            return false;
-    }
-
-    return true;
-}
-
 /**
  * @param argc
  * @param argv
@@ -102,14 +71,154 @@ static std::string getArg(const std::vector<std::string> *args, const std::strin
     return {""};
 }
 
-static void logHunk(const Hunk &hunk, std::ofstream &maybeOut)
+/**
+ * @param args
+ * @param prefix
+ *
+ * @brief Same as getArg(), but for an argument
+ * that may be passed several times.
+ *
+ * @returns Every parameter, in the order they were passed.
+ */
+static std::vector<std::string> getArgs(const std::vector<std::string> *args, const std::string &prefix)
 {
-    char logBuffer[MAX_BUFFER_LENGTH] = {0};
+    std::vector<std::string> retVal;
+
+    for (size_t i = 0, max = args->size(); i < max; i++)
+    {
+        const std::string &current = args->at(i);
+        const size_t prefixLength = prefix.length();
+
+        if (current.find(prefix) != 0)
+            continue;
+        if (current.length() > prefixLength + 1 && current[prefixLength] == '=')
+            retVal.push_back(current.substr(prefixLength + 1));
+        else if (i + 1 < max)
+            retVal.push_back(args->at(++i));
+    }
+
+    return retVal;
+}
+
+/**
+ * @param fileName
+ * @param fieldCount
+ *
+ * @brief Reads a manifest, made of one job per
+ * line with fieldCount whitespace separated paths.
+ *
+ * @details Empty lines and lines starting
+ * with '#' are skipped.
+ */
+static std::vector<std::vector<std::string>> readManifest(const std::string &fileName, const size_t fieldCount)
+{
+    std::ifstream manifest = std::ifstream(fileName);
+    std::vector<std::vector<std::string>> retVal;
+    std::string line;
 
-    if (hunk.bytes() == nullptr)
-        return;
+    if (!manifest.is_open())
+        FATAL_ERROR("Couldn't open the manifest '" << fileName << "'.");
+
+    for (size_t lineNumber = 1; std::getline(manifest, line); lineNumber++)
+    {
+        std::istringstream fields = std::istringstream(line);
+        std::vector<std::string> job;
+        std::string field;
 
-    std::snprintf(logBuffer, MAX_BUFFER_LENGTH, "Offset: %X\tSize: %lX\n", hunk.offset(), hunk.bytes()->size());
+        while (fields >> field)
+            job.push_back(field);
+
+        if (job.empty() || job[0][0] == '#')
+            continue;
+        if (job.size() != fieldCount)
+            FATAL_ERROR("Line " << lineNumber << " of the manifest should hold " << fieldCount << " paths.");
+
+        retVal.push_back(job);
+    }
+
+    return retVal;
+}
+
+/**
+ * @param threadCountArg
+ *
+ * @brief Parses -j's parameter, batches running on
+ * as many threads as the machine has by default.
+ */
+static size_t batchThreadCount(const std::string &threadCountArg)
+{
+    if (!threadCountArg.empty())
+        return std::strtoul(threadCountArg.c_str(), nullptr, 10);
+
+    return std::max(1U, std::thread::hardware_concurrency());
+}
+
+/**
+ * @param checksumArg
+ *
+ * @brief Parses --source-hash's or --output-hash's parameter,
+ * a hash name and its hexadecimal value, e.g. "crc32:1a2b3c4d"
+ * or "xxh64:0123456789abcdef". None is expected if it's empty.
+ */
+static MidIPS::Checksum parseChecksum(const std::string &checksumArg)
+{
+    MidIPS::Checksum retVal;
+    const size_t colon = checksumArg.find(':');
+
+    if (checksumArg.empty())
+        return retVal;
+    if (colon == std::string::npos || colon + 1 == checksumArg.size())
+        FATAL_ERROR("Invalid checksum provided, expected crc32:HEX or xxh64:HEX.");
+
+    const std::string hashName = checksumArg.substr(0, colon);
+    const std::string digits = checksumArg.substr(colon + 1);
+    char *end = nullptr;
+
+    if (hashName == "crc32" && digits.size() <= 8)
+        retVal.hash = MidIPS::Hash::CRC32;
+    else if (hashName == "xxh64" && digits.size() <= 16)
+        retVal.hash = MidIPS::Hash::XXH64;
+    else
+        FATAL_ERROR("Invalid checksum provided, expected crc32:HEX or xxh64:HEX.");
+
+    retVal.value = std::strtoull(digits.c_str(), &end, 16);
+
+    if (*end != '\0' || digits[0] == '-' || digits[0] == '+')
+        FATAL_ERROR("Invalid checksum provided, expected crc32:HEX or xxh64:HEX.");
+
+    return retVal;
+}
+
+/**
+ * @param formatArg
+ *
+ * @brief Parses -f's parameter, IPS by default.
+ */
+static MidIPS::Format parseFormat(const std::string &formatArg)
+{
+    if (formatArg.empty() || formatArg == "ips")
+        return MidIPS::Format::IPS;
+    if (formatArg == "bps")
+        return MidIPS::Format::BPS;
+    if (formatArg == "ups")
+        return MidIPS::Format::UPS;
+
+    FATAL_ERROR("Invalid -f argument provided.");
+}
+
+/**
+ * @param offset
+ * @param size
+ * @param maybeOut
+ *
+ * @brief Logs a Hunk, either into maybeOut
+ * if it's open or on stdout.
+ */
+static void logHunk(const size_t offset, const size_t size, std::ofstream &maybeOut)
+{
+    char logBuffer[MAX_BUFFER_LENGTH] = {0};
+
+    std::snprintf(logBuffer, MAX_BUFFER_LENGTH, "Offset: %lX\tSize: %lX\n", offset, size);
 
     if (maybeOut.is_open())
     {
@@ -122,6 +231,90 @@ static void logHunk(const Hunk &hunk, std::ofstream &maybeOut)
     }
 }
 
+/**
+ * @param status
+ * @param report
+ *
+ * @brief Exits the program if status is an error.
+ */
+static void checkReport(const MidIPS::Status status, const MidIPS::Report &report)
+{
+    if (status != MidIPS::Status::Ok)
+        FATAL_ERROR((report.detail.empty() ? MidIPS::describe(status) : report.detail));
+}
+
+/**
+ * @param args
+ *
+ * @brief Creates an IPS patch for each target,
+ * all of them against the same source.
+ *
+ * @details The targets and their patches come from the
+ * -b manifest, a "TARGET PATCH" pair per line, and from
+ * the -t and -o arguments, paired in order. A failing
+ * job doesn't stop the others.
+ */
+static int createIPSBatch(const std::vector<std::string> *args)
+{
+    const std::string sourceFileName = getArg(args, "-c");
+    const std::string manifestFileName = getArg(args, "-b");
+    const std::vector<std::string> targetFileNames = getArgs(args, "-t");
+    const std::vector<std::string> outputFileNames = getArgs(args, "-o");
+    std::vector<MidIPS::CreateJob> jobs;
+    MidIPS::Options options;
+    MidIPS::Report report;
+    int retVal = 0;
+
+    options.threadCount = batchThreadCount(getArg(args, "-j"));
+    options.indexName = getArg(args, "-i");
+    options.format = parseFormat(getArg(args, "-f"));
+
+    if (sourceFileName.empty())
+        FATAL_ERROR("Empty -c argument provided.");
+    if (targetFileNames.size() != outputFileNames.size())
+        FATAL_ERROR("Every -t argument needs its own -o argument.");
+    if (options.threadCount == 0)
+        FATAL_ERROR("Invalid -j argument provided.");
+
+    if (!manifestFileName.empty())
+    {
+        const std::vector<std::vector<std::string>> manifest = readManifest(manifestFileName, 2);
+
+        for (size_t i = 0, max = manifest.size(); i < max; i++)
+        {
+            jobs.push_back(MidIPS::CreateJob());
+            jobs.back().targetName = manifest[i][0];
+            jobs.back().patchName = manifest[i][1];
+        }
+    }
+
+    for (size_t i = 0, max = targetFileNames.size(); i < max; i++)
+    {
+        jobs.push_back(MidIPS::CreateJob());
+        jobs.back().targetName = targetFileNames[i];
+        jobs.back().patchName = outputFileNames[i];
+    }
+
+    if (MidIPS::createBatch(sourceFileName, jobs, options, &report) != MidIPS::Status::Ok && !report.detail.empty())
+        FATAL_ERROR(report.detail);
+
+    for (size_t i = 0, max = jobs.size(); i < max; i++)
+    {
+        const MidIPS::CreateJob &job = jobs[i];
+
+        if (job.status != MidIPS::Status::Ok)
+        {
+            std::cerr << job.targetName << ": " << (job.report.detail.empty() ? MidIPS::describe(job.status) : job.report.detail) << "\n";
+            retVal = 1;
+            continue;
+        }
+
+        std::printf("%s: %lu hunk(s)\n", job.patchName.c_str(), job.report.hunkCount);
+    }
+
+    return retVal;
+}
+
 /**
  * @param args
  *
@@ -137,8 +330,18 @@ static int createIPSPatch(const std::vector<std::string> *args)
     const std::string targetFileName = getArg(args, "-t");
     const std::string outputFileName = getArg(args, "-o");
     const std::string logFileName = getArg(args, "-l");
-    const bool allowAboveU24 = getArg(args, "--allow-above-u24", true) == "--alow-above-u24";
+    const std::string threadCountArg = getArg(args, "-j");
     std::ofstream logFile = std::ofstream(logFileName);
+    MidIPS::Options options;
+    MidIPS::Report report;
+
+    // More than one target, they're all diffed against the source at once.
+    if (!getArg(args, "-b").empty() || getArgs(args, "-t").size() > 1)
+        return createIPSBatch(args);
+
+    options.threadCount = threadCountArg.empty() ? 1 : std::strtoul(threadCountArg.c_str(), nullptr, 10);
+    options.indexName = getArg(args, "-i");
+    options.format = parseFormat(getArg(args, "-f"));
 
     // If there were missing parameters.
     if (sourceFileName.empty())
@@ -147,28 +350,67 @@ static int createIPSPatch(const std::vector<std::string> *args)
         FATAL_ERROR("Empty -t argument provided.");
     if (outputFileName.empty())
         FATAL_ERROR("Empty -o argument provided.");
+    if (options.threadCount == 0)
+        FATAL_ERROR("Invalid -j argument provided.");
 
-    // BigEdian handles opening files and errors regarding those.
-    BigEdian sourceFile = {sourceFileName, std::ios::in | std::ios::out | std::ios::binary};
-    BigEdian targetFile = {targetFileName, std::ios::in | std::ios::out | std::ios::binary};
-    BigEdian outputFile = {outputFileName, std::ios::out | std::ios::binary};
+    options.onHunk = [&logFile](size_t offset, size_t size)
+    { logHunk(offset, size, logFile); };
 
-    // Writing the standard IPS header, whether or not there are changes.
-    outputFile.writeBytes(gMagicHeader, gMagicHeaderLength);
+    checkReport(MidIPS::createFile(sourceFileName, targetFileName, outputFileName, options, &report), report);
 
-    // Looping until we reach the end of one of the files.
-    while (!sourceFile.isEnd() && !targetFile.isEnd())
+    logFile.close();
+    return 0;
+}
+
+/**
+ * @param args
+ *
+ * @brief Applies every job of the -b manifest,
+ * a "PATCH SUBJECT OUTPUT" triplet per line.
+ *
+ * @details Each patch is parsed once, whatever the number
+ * of jobs using it. A failing job is reported without
+ * stopping the others.
+ */
+static int applyIPSBatch(const std::vector<std::string> *args)
+{
+    const std::vector<std::vector<std::string>> manifest = readManifest(getArg(args, "-b"), 3);
+    std::vector<MidIPS::ApplyJob> jobs;
+    MidIPS::Options options;
+    MidIPS::Report report;
+    int retVal = 0;
+
+    options.threadCount = batchThreadCount(getArg(args, "-j"));
+
+    if (options.threadCount == 0)
+        FATAL_ERROR("Invalid -j argument provided.");
+
+    for (size_t i = 0, max = manifest.size(); i < max; i++)
     {
-        Hunk diffHunk = Hunk::fromDiff(&sourceFile, &targetFile);
-        diffHunk.asIPS(&outputFile, allowAboveU24);
+        jobs.push_back(MidIPS::ApplyJob());
+        jobs.back().patchName = manifest[i][0];
+        jobs.back().subjectName = manifest[i][1];
+        jobs.back().outputName = manifest[i][2];
+    }
+
+    if (MidIPS::applyBatch(jobs, options, &report) != MidIPS::Status::Ok && !report.detail.empty())
+        FATAL_ERROR(report.detail);
 
-        logHunk(diffHunk, logFile);
+    for (size_t i = 0, max = jobs.size(); i < max; i++)
+    {
+        const MidIPS::ApplyJob &job = jobs[i];
+
+        if (job.status != MidIPS::Status::Ok)
+        {
+            std::cerr << job.outputName << ": " << (job.report.detail.empty() ? MidIPS::describe(job.status) : job.report.detail) << "\n";
+            retVal = 1;
+            continue;
+        }
+
+        std::printf("%s: %lu hunk(s)\n", job.outputName.c_str(), job.report.hunkCount);
     }
 
-    // Making sure the changes are actually written.
-    outputFile.flush();
-    logFile.close();
-    return 0;
+    return retVal;
 }
 
 /**
@@ -177,44 +419,141 @@ static int createIPSPatch(const std::vector<std::string> *args)
  * @brief Applies an IPS patch on a file.
  *
  * @details Expects an IPS file and a 'subject'
- * file. It will first check for the header, and then
- * try to apply each section of the patch.
+ * file, and optionally an output file, in which
+ * case the subject is left untouched, and an undo
+ * file, receiving the patch that reverts it.
  */
 static int applyIPSPatch(const std::vector<std::string> *args)
 {
     const std::string IPSFileName = getArg(args, "-p");
     const std::string fileToApplyOnFileName = getArg(args, "-a");
+    const std::string outputFileName = getArg(args, "-o");
     const std::string logFileName = getArg(args, "-l");
-    const bool allowAboveU24 = getArg(args, "--allow-above-u24", true) == "--allow-above-u24";
+    const std::string threadCountArg = getArg(args, "-j");
     std::ofstream logFile = std::ofstream(logFileName);
+    MidIPS::Options options;
+    MidIPS::Report report;
+
+    // Many jobs at once, from a manifest.
+    if (!getArg(args, "-b").empty())
+        return applyIPSBatch(args);
+
+    options.threadCount = threadCountArg.empty() ? 1 : std::strtoul(threadCountArg.c_str(), nullptr, 10);
+    options.undoName = getArg(args, "--undo-out");
+    options.sourceChecksum = parseChecksum(getArg(args, "--source-hash"));
+    options.outputChecksum = parseChecksum(getArg(args, "--output-hash"));
+    options.onHunk = [&logFile](size_t offset, size_t size)
+    { logHunk(offset, size, logFile); };
 
     // Missing parameters.
     if (IPSFileName.empty())
         FATAL_ERROR("Empty -p argument provided.");
     if (fileToApplyOnFileName.empty())
         FATAL_ERROR("Empty -a argument provided.");
+    if (options.threadCount == 0)
+        FATAL_ERROR("Invalid -j argument provided.");
 
-    BigEdian IPSFile = {IPSFileName, std::ios::in | std::ios::out | std::ios::binary};
-    BigEdian fileToApplyOn = {fileToApplyOnFileName, std::ios::in | std::ios::out | std::ios::binary};
+    checkReport(MidIPS::applyFile(IPSFileName, fileToApplyOnFileName, outputFileName, options, &report), report);
 
-    if (!areBytesEqual(IPSFile.readBytes(gMagicHeaderLength), gMagicHeader, gMagicHeaderLength))
-        FATAL_ERROR("The passed file is not a valid IPS Patch.");
+    logFile.close();
+    return 0;
+}
 
-    // Looping until we reach the end of the IPS file, the inner
-    // processes also check for the end and exit the program if they
-    // unexpectedly encounter it.
-    while (!IPSFile.isEnd())
-    {
-        Hunk toApply = Hunk::fromIPS(&IPSFile, allowAboveU24);
-        toApply.write(&fileToApplyOn, allowAboveU24);
+/**
+ * @param args
+ *
+ * @brief Checks an IPS patch against a file,
+ * without applying it.
+ *
+ * @details Expects an IPS file and a 'subject'
+ * file. It exits with an error if applying the
+ * patch would fail, and tells what it would do
+ * otherwise.
+ */
+static int validateIPSPatch(const std::vector<std::string> *args)
+{
+    const std::string IPSFileName = getArg(args, "-p");
+    const std::string fileToApplyOnFileName = getArg(args, "-a");
+    MidIPS::Options options;
+    MidIPS::Report report;
 
-        logHunk(toApply, logFile);
-    }
+    options.sourceChecksum = parseChecksum(getArg(args, "--source-hash"));
+    options.outputChecksum = parseChecksum(getArg(args, "--output-hash"));
+
+    // Missing parameters.
+    if (IPSFileName.empty())
+        FATAL_ERROR("Empty -p argument provided.");
+    if (fileToApplyOnFileName.empty())
+        FATAL_ERROR("Empty -a argument provided.");
+
+    checkReport(MidIPS::validateFile(IPSFileName, fileToApplyOnFileName, options, &report), report);
+
+    std::printf("Hunks: %lu\tBytes: %lX\tSize: %lX\n", report.hunkCount, report.byteCount, report.outputSize);
+    return 0;
+}
+
+/**
+ * @param args
+ *
+ * @brief Squashes a chain of IPS patches into one.
+ *
+ * @details Expects the base file the chain starts from,
+ * the patches, in the order they're applied, and an output
+ * file. Applying the output on the base then gives the
+ * same file as applying the whole chain.
+ */
+static int squashIPSPatches(const std::vector<std::string> *args)
+{
+    const std::vector<std::string> IPSFileNames = getArgs(args, "-p");
+    const std::string baseFileName = getArg(args, "-a");
+    const std::string outputFileName = getArg(args, "-o");
+    const std::string logFileName = getArg(args, "-l");
+    std::ofstream logFile = std::ofstream(logFileName);
+    MidIPS::Options options;
+    MidIPS::Report report;
+
+    options.onHunk = [&logFile](size_t offset, size_t size)
+    { logHunk(offset, size, logFile); };
+
+    // Missing parameters.
+    if (IPSFileNames.empty())
+        FATAL_ERROR("Empty -p argument provided.");
+    if (baseFileName.empty())
+        FATAL_ERROR("Empty -a argument provided.");
+    if (outputFileName.empty())
+        FATAL_ERROR("Empty -o argument provided.");
+
+    checkReport(MidIPS::squashFile(IPSFileNames, baseFileName, outputFileName, options, &report), report);
 
     logFile.close();
     return 0;
 }
 
+/**
+ * @param args
+ *
+ * @brief Indexes a source file, for creating
+ * patches against it faster.
+ *
+ * @details Expects a source and an output file,
+ * the index is then passed to create mode with -i.
+ */
+static int indexSource(const std::vector<std::string> *args)
+{
+    const std::string sourceFileName = getArg(args, "-c");
+    const std::string outputFileName = getArg(args, "-o");
+    MidIPS::Report report;
+
+    // Missing parameters.
+    if (sourceFileName.empty())
+        FATAL_ERROR("Empty -c argument provided.");
+    if (outputFileName.empty())
+        FATAL_ERROR("Empty -o argument provided.");
+
+    checkReport(MidIPS::indexFile(sourceFileName, outputFileName, &report), report);
+    return 0;
+}
+
 /**
  * @brief Prints the usage "manual" of
  * this program.
@@ -224,7 +563,7 @@ static int applyIPSPatch(const std::vector<std::string> *args)
  */
 static int printUsage()
 {
-    std::printf("Usage: midips -m=[apply|a]|[create|c] [-p=PATCH] [-a=FILE] [-c=SOURCE] [-t=TARGET] [-o=OUTPUT PATCH]\n");
+    std::printf("Usage: midips -m=[apply|a]|[create|c]|[validate|v]|[squash|s]|[index|i] [-p=PATCH] [-a=FILE] [-c=SOURCE] [-t=TARGET] [-o=OUTPUT PATCH|FILE|INDEX] [-b=MANIFEST] [-f=ips|bps|ups] [-i=INDEX] [-j=THREADS] [--undo-out=UNDO PATCH] [--source-hash=crc32|xxh64:HEX] [--output-hash=crc32|xxh64:HEX]\n");
     return 0;
 }
 
@@ -236,11 +575,17 @@ int main(int argc, char **argv)
     const std::vector<std::string> *args = parseArgs(--argc, ++argv);
     const std::string modeArg = getArg(args, "-m");
 
-    // Only valid modes are apply/a and create/c
+    // Only valid modes are apply/a, create/c, validate/v, squash/s and index/i
     if (modeArg == "apply" || modeArg == "a")
         return applyIPSPatch(args);
     if (modeArg == "create" || modeArg == "c")
         return createIPSPatch(args);
+    if (modeArg == "validate" || modeArg == "v")
+        return validateIPSPatch(args);
+    if (modeArg == "squash" || modeArg == "s")
+        return squashIPSPatches(args);
+    if (modeArg == "index" || modeArg == "i")
+        return indexSource(args);
 
     return printUsage();
 }
\ No newline at end of file
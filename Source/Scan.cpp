@@ -0,0 +1,297 @@
+#include <cstring>
+#include "Scan.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SCAN_X86
+#endif // __GNUC__ && x86
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SCAN_LITTLE_ENDIAN
+#endif // __BYTE_ORDER__
+
+//! @brief Has every byte's lowest bit set, used to find zero bytes within a word.
+#define LOW_BITS 0x0101010101010101ULL
+
+//! @brief Has every byte's highest bit set, used to find zero bytes within a word.
+#define HIGH_BITS 0x8080808080808080ULL
+
+//! @brief Signature shared by every implementation of a scan.
+typedef size_t (*ScanFunction)(const u8 *, const u8 *, const size_t);
+
+//! @brief The scans picked for this CPU.
+struct Scanner
+{
+    ScanFunction mismatch;
+    ScanFunction match;
+    const char *name;
+};
+
+/**
+ * @param bytes
+ *
+ * @brief Loads 8 bytes, whatever their alignment.
+ */
+static u64 loadWord(const u8 *bytes)
+{
+    u64 word;
+
+    std::memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+/**
+ * @param bytes1
+ * @param bytes2
+ * @param length
+ *
+ * @brief Portable findMismatch(), comparing
+ * 8 bytes at once.
+ */
+static size_t scalarMismatch(const u8 *bytes1, const u8 *bytes2, const size_t length)
+{
+    size_t i = 0;
+
+#ifdef SCAN_LITTLE_ENDIAN
+    for (; i + sizeof(u64) <= length; i += sizeof(u64))
+    {
+        const u64 difference = loadWord(bytes1 + i) ^ loadWord(bytes2 + i);
+
+        // The first differing byte is the lowest one, in memory order.
+        if (difference != 0)
+            return i + __builtin_ctzll(difference) / 8;
+    }
+#endif // SCAN_LITTLE_ENDIAN
+
+    while (i < length && bytes1[i] == bytes2[i])
+        i++;
+
+    return i;
+}
+
+/**
+ * @param bytes1
+ * @param bytes2
+ * @param length
+ *
+ * @brief Portable findMatch(), comparing
+ * 8 bytes at once.
+ */
+static size_t scalarMatch(const u8 *bytes1, const u8 *bytes2, const size_t length)
+{
+    size_t i = 0;
+
+#ifdef SCAN_LITTLE_ENDIAN
+    for (; i + sizeof(u64) <= length; i += sizeof(u64))
+    {
+        const u64 difference = loadWord(bytes1 + i) ^ loadWord(bytes2 + i);
+        const u64 zeroes = (difference - LOW_BITS) & ~difference & HIGH_BITS;
+
+        // Only bytes above a real zero can be wrongly flagged,
+        // so the lowest flag always is an equal byte.
+        if (zeroes != 0)
+            return i + __builtin_ctzll(zeroes) / 8;
+    }
+#endif // SCAN_LITTLE_ENDIAN
+
+    while (i < length && bytes1[i] != bytes2[i])
+        i++;
+
+    return i;
+}
+
+#ifdef SCAN_X86
+/**
+ * @param bytes1
+ * @param bytes2
+ * @param length
+ *
+ * @brief findMismatch() with SSE2,
+ * comparing 16 bytes at once.
+ */
+__attribute__((target("sse2"))) static size_t sse2Mismatch(const u8 *bytes1, const u8 *bytes2, const size_t length)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16)
+    {
+        const __m128i block1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes1 + i));
+        const __m128i block2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes2 + i));
+        const unsigned differing = _mm_movemask_epi8(_mm_cmpeq_epi8(block1, block2)) ^ 0xFFFF;
+
+        if (differing != 0)
+            return i + __builtin_ctz(differing);
+    }
+
+    return i + scalarMismatch(bytes1 + i, bytes2 + i, length - i);
+}
+
+/**
+ * @param bytes1
+ * @param bytes2
+ * @param length
+ *
+ * @brief findMatch() with SSE2,
+ * comparing 16 bytes at once.
+ */
+__attribute__((target("sse2"))) static size_t sse2Match(const u8 *bytes1, const u8 *bytes2, const size_t length)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16)
+    {
+        const __m128i block1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes1 + i));
+        const __m128i block2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes2 + i));
+        const unsigned equal = _mm_movemask_epi8(_mm_cmpeq_epi8(block1, block2));
+
+        if (equal != 0)
+            return i + __builtin_ctz(equal);
+    }
+
+    return i + scalarMatch(bytes1 + i, bytes2 + i, length - i);
+}
+
+/**
+ * @param bytes1
+ * @param bytes2
+ * @param length
+ *
+ * @brief findMismatch() with AVX2, comparing 64
+ * bytes at once, then 32.
+ *
+ * @details Equal regions are usually huge, so the
+ * main loop only checks both halves together and
+ * looks for the exact byte once something differs.
+ */
+__attribute__((target("avx2"))) static size_t avx2Mismatch(const u8 *bytes1, const u8 *bytes2, const size_t length)
+{
+    size_t i = 0;
+
+    for (; i + 64 <= length; i += 64)
+    {
+        const __m256i low1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes1 + i));
+        const __m256i low2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes2 + i));
+        const __m256i high1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes1 + i + 32));
+        const __m256i high2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes2 + i + 32));
+        const __m256i lowEqual = _mm256_cmpeq_epi8(low1, low2);
+        const __m256i highEqual = _mm256_cmpeq_epi8(high1, high2);
+
+        if (static_cast<u32>(_mm256_movemask_epi8(_mm256_and_si256(lowEqual, highEqual))) == U32_MAX)
+            continue;
+
+        const u32 lowDiffering = ~static_cast<u32>(_mm256_movemask_epi8(lowEqual));
+
+        if (lowDiffering != 0)
+            return i + __builtin_ctz(lowDiffering);
+
+        return i + 32 + __builtin_ctz(~static_cast<u32>(_mm256_movemask_epi8(highEqual)));
+    }
+
+    for (; i + 32 <= length; i += 32)
+    {
+        const __m256i block1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes1 + i));
+        const __m256i block2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes2 + i));
+        const u32 differing = ~static_cast<u32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block1, block2)));
+
+        if (differing != 0)
+            return i + __builtin_ctz(differing);
+    }
+
+    return i + scalarMismatch(bytes1 + i, bytes2 + i, length - i);
+}
+
+/**
+ * @param bytes1
+ * @param bytes2
+ * @param length
+ *
+ * @brief findMatch() with AVX2,
+ * comparing 32 bytes at once.
+ */
+__attribute__((target("avx2"))) static size_t avx2Match(const u8 *bytes1, const u8 *bytes2, const size_t length)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32)
+    {
+        const __m256i block1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes1 + i));
+        const __m256i block2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes2 + i));
+        const u32 equal = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block1, block2));
+
+        if (equal != 0)
+            return i + __builtin_ctz(equal);
+    }
+
+    return i + scalarMatch(bytes1 + i, bytes2 + i, length - i);
+}
+#endif // SCAN_X86
+
+/**
+ * @brief Picks the widest scans
+ * this CPU supports.
+ */
+static Scanner pickScanner()
+{
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return {avx2Mismatch, avx2Match, "avx2"};
+    if (__builtin_cpu_supports("sse2"))
+        return {sse2Mismatch, sse2Match, "sse2"};
+#endif // SCAN_X86
+
+    return {scalarMismatch, scalarMatch, "scalar"};
+}
+
+/**
+ * @brief Returns the scans picked for this CPU,
+ * they're only picked once.
+ */
+static const Scanner &scanner()
+{
+    static const Scanner picked = pickScanner();
+
+    return picked;
+}
+
+/**
+ * @param bytes1
+ * @param bytes2
+ * @param length
+ *
+ * @brief Finds the first byte that differs
+ * between bytes1 and bytes2.
+ *
+ * @returns Its index, or length if they're
+ * the same all along.
+ */
+size_t findMismatch(const u8 *bytes1, const u8 *bytes2, const size_t length)
+{
+    return scanner().mismatch(bytes1, bytes2, length);
+}
+
+/**
+ * @param bytes1
+ * @param bytes2
+ * @param length
+ *
+ * @brief Finds the first byte that is the
+ * same in both bytes1 and bytes2.
+ *
+ * @returns Its index, or length if they
+ * differ all along.
+ */
+size_t findMatch(const u8 *bytes1, const u8 *bytes2, const size_t length)
+{
+    return scanner().match(bytes1, bytes2, length);
+}
+
+/**
+ * @brief Names the scans picked for
+ * this CPU, e.g. "avx2".
+ */
+const char *scanVariant()
+{
+    return scanner().name;
+}
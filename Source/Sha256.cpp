@@ -0,0 +1,227 @@
+#include <cstring>
+#include "Sha256.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA256_X86
+#endif // __GNUC__ && x86
+
+//! @brief Size of the blocks SHA-256 works on.
+#define SHA256_BLOCK_SIZE 64
+
+//! @brief Signature shared by every implementation of the compression.
+typedef void (*CompressFunction)(u32 *, const u8 *, size_t);
+
+//! @brief Round constants.
+static const u32 sRoundConstants[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+//! @brief Initial state.
+static const u32 sInitialState[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+/**
+ * @param value
+ * @param count
+ *
+ * @brief Rotates value right by count bits.
+ */
+static u32 rotateRight(const u32 value, const u32 count)
+{
+    return (value >> count) | (value << (32 - count));
+}
+
+/**
+ * @param state
+ * @param blocks
+ * @param blockCount
+ *
+ * @brief Portable compression of blockCount
+ * blocks into state.
+ */
+static void scalarCompress(u32 *state, const u8 *blocks, size_t blockCount)
+{
+    u32 schedule[64];
+
+    for (; blockCount > 0; blockCount--, blocks += SHA256_BLOCK_SIZE)
+    {
+        for (size_t i = 0; i < 16; i++)
+            schedule[i] = (blocks[i * 4] << 24) | (blocks[i * 4 + 1] << 16) | (blocks[i * 4 + 2] << 8) | blocks[i * 4 + 3];
+
+        for (size_t i = 16; i < 64; i++)
+        {
+            const u32 sigma0 = rotateRight(schedule[i - 15], 7) ^ rotateRight(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3);
+            const u32 sigma1 = rotateRight(schedule[i - 2], 17) ^ rotateRight(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10);
+
+            schedule[i] = schedule[i - 16] + sigma0 + schedule[i - 7] + sigma1;
+        }
+
+        u32 a = state[0], b = state[1], c = state[2], d = state[3];
+        u32 e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (size_t i = 0; i < 64; i++)
+        {
+            const u32 sum1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+            const u32 choice = (e & f) ^ (~e & g);
+            const u32 temp1 = h + sum1 + choice + sRoundConstants[i] + schedule[i];
+            const u32 sum0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+            const u32 majority = (a & b) ^ (a & c) ^ (b & c);
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + temp1;
+            d = c;
+            c = b;
+            b = a;
+            a = temp1 + sum0 + majority;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef SHA256_X86
+/**
+ * @param state
+ * @param blocks
+ * @param blockCount
+ *
+ * @brief Compression with the SHA extensions,
+ * 4 rounds per pair of instructions.
+ */
+__attribute__((target("sha,sse4.1,ssse3"))) static void shaCompress(u32 *state, const u8 *blocks, size_t blockCount)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+    __m128i temp = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4));
+
+    // The instructions expect ABEF and CDGH.
+    temp = _mm_shuffle_epi32(temp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+
+    __m128i state0 = _mm_alignr_epi8(temp, state1, 8);
+
+    state1 = _mm_blend_epi16(state1, temp, 0xF0);
+
+    for (; blockCount > 0; blockCount--, blocks += SHA256_BLOCK_SIZE)
+    {
+        const __m128i savedState0 = state0;
+        const __m128i savedState1 = state1;
+        __m128i messages[4];
+
+        for (size_t i = 0; i < 4; i++)
+            messages[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks + i * 16)), byteSwap);
+
+        for (size_t i = 0; i < 16; i++)
+        {
+            // The next 4 words of the schedule replace the oldest ones.
+            if (i >= 4)
+            {
+                __m128i next = _mm_sha256msg1_epu32(messages[i % 4], messages[(i + 1) % 4]);
+
+                next = _mm_add_epi32(next, _mm_alignr_epi8(messages[(i + 3) % 4], messages[(i + 2) % 4], 4));
+                messages[i % 4] = _mm_sha256msg2_epu32(next, messages[(i + 3) % 4]);
+            }
+
+            const __m128i message = _mm_add_epi32(messages[i % 4], _mm_loadu_si128(reinterpret_cast<const __m128i *>(sRoundConstants + i * 4)));
+
+            state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(message, 0x0E));
+        }
+
+        state0 = _mm_add_epi32(state0, savedState0);
+        state1 = _mm_add_epi32(state1, savedState1);
+    }
+
+    // Back to ABCD and EFGH.
+    temp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(temp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, temp, 8);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), state1);
+}
+#endif // SHA256_X86
+
+/**
+ * @brief Picks the SHA extensions
+ * when this CPU has them.
+ */
+static CompressFunction pickCompress()
+{
+#ifdef SHA256_X86
+    unsigned int eax = 0;
+    unsigned int ebx = 0;
+    unsigned int ecx = 0;
+    unsigned int edx = 0;
+
+    __builtin_cpu_init();
+
+    // The SHA extensions are bit 29 of the extended features.
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1 << 29)) && __builtin_cpu_supports("sse4.1"))
+        return shaCompress;
+#endif // SHA256_X86
+
+    return scalarCompress;
+}
+
+/**
+ * @param bytes
+ * @param length
+ * @param digest
+ *
+ * @brief Computes the SHA-256 digest of
+ * length bytes into digest.
+ *
+ * @details digest has to hold SHA256_SIZE bytes.
+ */
+void sha256(const u8 *bytes, const size_t length, u8 *digest)
+{
+    static const CompressFunction compress = pickCompress();
+    const size_t fullCount = length / SHA256_BLOCK_SIZE;
+    const size_t leftLength = length % SHA256_BLOCK_SIZE;
+    u8 last[SHA256_BLOCK_SIZE * 2] = {0};
+    u32 state[8];
+
+    std::memcpy(state, sInitialState, sizeof(state));
+    compress(state, bytes, fullCount);
+
+    // Padding: a 1 bit, zeroes, and the length in bits.
+    const size_t lastLength = leftLength + 9 > SHA256_BLOCK_SIZE ? SHA256_BLOCK_SIZE * 2 : SHA256_BLOCK_SIZE;
+    const u64 bitLength = static_cast<u64>(length) * 8;
+
+    std::memcpy(last, bytes + fullCount * SHA256_BLOCK_SIZE, leftLength);
+    last[leftLength] = 0x80;
+
+    for (size_t i = 0; i < 8; i++)
+        last[lastLength - 1 - i] = bitLength >> (i * 8);
+
+    compress(state, last, lastLength / SHA256_BLOCK_SIZE);
+
+    for (size_t i = 0; i < 8; i++)
+    {
+        digest[i * 4] = state[i] >> 24;
+        digest[i * 4 + 1] = state[i] >> 16;
+        digest[i * 4 + 2] = state[i] >> 8;
+        digest[i * 4 + 3] = state[i];
+    }
+}
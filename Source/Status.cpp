@@ -0,0 +1,36 @@
+#include "Status.hpp"
+
+/**
+ * @param status
+ *
+ * @brief Gives a short, human readable
+ * description of status.
+ *
+ * @returns A static string, never nullptr.
+ */
+const char *MidIPS::describe(const Status status)
+{
+    switch (status)
+    {
+    case Status::Ok:
+        return "No error.";
+    case Status::OpenFailed:
+        return "Unable to open a file.";
+    case Status::ReadFailed:
+        return "Errors occurred while reading.";
+    case Status::WriteFailed:
+        return "Errors occurred while writing.";
+    case Status::InvalidArgument:
+        return "Invalid argument.";
+    case Status::InvalidHeader:
+        return "Not a valid IPS Patch.";
+    case Status::Truncated:
+        return "Reached end of file.";
+    case Status::OffsetOutOfRange:
+        return "Offset bigger than file size.";
+    case Status::ChecksumMismatch:
+        return "Checksum mismatch.";
+    }
+
+    return "Unknown error.";
+}
@@ -0,0 +1,231 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "StreamReader.hpp"
+
+//! @brief Size of each of the two blocks a stream is read into.
+#define STREAM_BLOCK_SIZE (1 << 20)
+
+/**
+ * @param fileName
+ *
+ * @brief Constructor that opens fileName, "-"
+ * being the standard input, and starts reading
+ * ahead right away.
+ *
+ * @details Failing to open it isn't fatal, the
+ * object is simply not good() afterwards.
+ */
+StreamReader::StreamReader(const std::string &fileName)
+{
+    m_fd = fileName == "-" ? STDIN_FILENO : open(fileName.c_str(), O_RDONLY);
+    m_fileName = fileName == "-" ? "<stdin>" : fileName;
+    m_status = MidIPS::Status::Ok;
+    m_next = 0;
+    m_isHeld = false;
+    m_isEnded = false;
+    m_isStopping = false;
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        m_buffers[i] = new u8[STREAM_BLOCK_SIZE];
+        m_lengths[i] = 0;
+        m_isFilled[i] = false;
+    }
+
+    if (m_fd < 0)
+    {
+        m_status = MidIPS::Status::OpenFailed;
+        m_isEnded = true;
+        return;
+    }
+
+    m_reader = std::thread(&StreamReader::readAhead, this);
+}
+
+/**
+ * @brief Destructor, stops the reading
+ * thread even if the stream isn't over.
+ */
+StreamReader::~StreamReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isStopping = true;
+    }
+
+    m_condition.notify_all();
+
+    if (m_reader.joinable())
+        m_reader.join();
+    if (m_fd > STDIN_FILENO)
+        close(m_fd);
+
+    delete[] m_buffers[0];
+    delete[] m_buffers[1];
+}
+
+/**
+ * @brief Fills both blocks in turn, each as
+ * soon as the previous one has been handed
+ * back.
+ *
+ * @details That's what the reading thread runs, so
+ * that reading the next block overlaps with whatever
+ * is done with the current one. Every block is full,
+ * but the last one.
+ */
+void StreamReader::readAhead()
+{
+    size_t current = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            m_condition.wait(lock, [this, current]
+                             { return m_isStopping || !m_isFilled[current]; });
+
+            if (m_isStopping)
+                return;
+        }
+
+        size_t length = 0;
+        bool isEnd = false;
+
+        while (length < STREAM_BLOCK_SIZE)
+        {
+            const ssize_t readCount = read(m_fd, m_buffers[current] + length, STREAM_BLOCK_SIZE - length);
+
+            if (readCount < 0 && errno == EINTR)
+                continue;
+            if (readCount <= 0)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                if (readCount < 0)
+                    m_status = MidIPS::Status::ReadFailed;
+
+                isEnd = true;
+                break;
+            }
+
+            length += readCount;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            m_lengths[current] = length;
+            m_isFilled[current] = true;
+            m_isEnded = isEnd;
+        }
+
+        m_condition.notify_all();
+
+        if (isEnd)
+            return;
+
+        current ^= 1;
+    }
+}
+
+/**
+ * @param length
+ *
+ * @brief Hands back the previous block,
+ * and returns the next one.
+ *
+ * @details Waits for it to be read if needed. It
+ * stays valid until the next call.
+ *
+ * @returns The block, and its length, which is
+ * only 0 once the stream is over.
+ */
+const u8 *StreamReader::next(size_t *length)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_isHeld)
+    {
+        m_isFilled[m_next ^ 1] = false;
+        m_isHeld = false;
+        m_condition.notify_all();
+    }
+
+    m_condition.wait(lock, [this]
+                     { return m_isFilled[m_next] || m_isEnded; });
+
+    if (!m_isFilled[m_next])
+    {
+        *length = 0;
+        return nullptr;
+    }
+
+    const u8 *block = m_buffers[m_next];
+
+    *length = m_lengths[m_next];
+    m_isHeld = true;
+    m_next ^= 1;
+    return block;
+}
+
+/**
+ * @brief Returns whether no
+ * error occurred so far.
+ */
+bool StreamReader::good()
+{
+    return status() == MidIPS::Status::Ok;
+}
+
+/**
+ * @brief Returns the first
+ * error that occurred.
+ */
+MidIPS::Status StreamReader::status()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_status;
+}
+
+/**
+ * @brief Describes the first error
+ * that occurred, with the file's name.
+ */
+std::string StreamReader::error()
+{
+    switch (status())
+    {
+    case MidIPS::Status::Ok:
+        return "";
+    case MidIPS::Status::OpenFailed:
+        return "Unable to open '" + m_fileName + "'.";
+    default:
+        return "Errors occurred while reading '" + m_fileName + "'.";
+    }
+}
+
+/**
+ * @param fileName
+ *
+ * @brief Tells whether fileName can only
+ * be read from start to end.
+ *
+ * @details That's the case of "-", named pipes
+ * and anything else but a regular file.
+ */
+bool StreamReader::isStream(const std::string &fileName)
+{
+    struct stat fileStat;
+
+    if (fileName == "-")
+        return true;
+    if (stat(fileName.c_str(), &fileStat) != 0)
+        return false;
+
+    return !S_ISREG(fileStat.st_mode);
+}
@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <cstring>
+#include "UPS.hpp"
+#include "Crc32.hpp"
+#include "Scan.hpp"
+#include "VarInt.hpp"
+
+//! @brief Header of every UPS patch, translates literally to "UPS1".
+static const u8 sUPSMagic[] = {0x55, 0x50, 0x53, 0x31};
+
+//! @brief Size of the footer: the source's, the target's and the patch's CRC-32.
+#define UPS_FOOTER_SIZE 12
+
+//! @brief Bytes diffed or patched at once, then checksummed while still in cache.
+#define UPS_CHUNK_SIZE 0x10000
+
+//! @brief Stands for the bytes past the end of the shorter file, which UPS takes as zeros.
+static const u8 sZeros[UPS_CHUNK_SIZE] = {0};
+
+//! @brief What a UPS patch's header and footer tell.
+struct UPSHeader
+{
+    u64 sourceSize;
+    u64 targetSize;
+    size_t recordsStart;
+    size_t recordsEnd;
+    u32 sourceCrc;
+    u32 targetCrc;
+};
+
+/**
+ * @param bytes
+ * @param length
+ * @param offset
+ * @param end
+ *
+ * @brief Gets the bytes of a file at [offset, end), the
+ * shorter file of a UPS patch being padded with zeros.
+ *
+ * @returns As many of them as are there in a row,
+ * or zeros, end being at most UPS_CHUNK_SIZE past
+ * offset. Its length ends up in end.
+ */
+static const u8 *padded(const u8 *bytes, const size_t length, const size_t offset, size_t *end)
+{
+    if (offset < length)
+    {
+        *end = std::min(*end, length);
+        return bytes + offset;
+    }
+
+    return sZeros;
+}
+
+/**
+ * @brief Constructor, nothing pushed yet.
+ */
+UPSEncoder::UPSEncoder() : m_sourceSize(0), m_targetSize(0), m_recordEnd(0), m_isInRecord(false), m_recordCount(0), m_byteCount(0), m_sourceCrc(0), m_targetCrc(0)
+{
+}
+
+/**
+ * @param source
+ * @param sourceLength
+ * @param target
+ * @param targetLength
+ *
+ * @brief Diffs the next bytes of both files, at
+ * most UPS_CHUNK_SIZE, into the records.
+ *
+ * @details Past the end of the shorter file, its bytes
+ * are zeros. A record starts at the first differing
+ * byte, holds the XOR of both files up to the next equal
+ * one, and ends with a 0 standing for that one.
+ */
+void UPSEncoder::pushChunk(const u8 *source, const size_t sourceLength, const u8 *target, const size_t targetLength)
+{
+    const u64 chunkStart = std::max(m_sourceSize, m_targetSize);
+    const size_t length = std::max(sourceLength, targetLength);
+    const size_t common = std::min(sourceLength, targetLength);
+    size_t i = 0;
+
+    while (i < length)
+    {
+        const size_t end = i < common ? common : length;
+        const u8 *sourceBytes = i < sourceLength ? source + i : sZeros;
+        const u8 *targetBytes = i < targetLength ? target + i : sZeros;
+
+        if (!m_isInRecord)
+        {
+            i += findMismatch(sourceBytes, targetBytes, end - i);
+
+            if (i == end)
+                continue;
+
+            u8 bytes[VAR_INT_MAX_LENGTH];
+
+            m_records.insert(m_records.end(), bytes, bytes + encodeNumber(chunkStart + i - m_recordEnd, bytes));
+            m_isInRecord = true;
+            m_recordCount++;
+        }
+        else
+        {
+            const size_t run = findMatch(sourceBytes, targetBytes, end - i);
+            const size_t recordLength = m_records.size();
+
+            m_records.resize(recordLength + run);
+
+            for (size_t k = 0; k < run; k++)
+                m_records[recordLength + k] = sourceBytes[k] ^ targetBytes[k];
+
+            m_byteCount += run;
+            i += run;
+
+            if (i == end)
+                continue;
+
+            // The equal byte ending the record.
+            m_records.push_back(0);
+            m_isInRecord = false;
+            m_recordEnd = chunkStart + ++i;
+        }
+    }
+}
+
+/**
+ * @param source
+ * @param sourceLength
+ * @param target
+ * @param targetLength
+ *
+ * @brief Diffs the next bytes of both files,
+ * checksumming them along the way.
+ *
+ * @details The files are pushed in order, block by
+ * block, a block shorter than the other one meaning
+ * its file is over. They're diffed and checksummed
+ * a chunk at a time, so each byte is only read from
+ * memory once, however big the files are.
+ */
+void UPSEncoder::push(const u8 *source, const size_t sourceLength, const u8 *target, const size_t targetLength)
+{
+    const size_t length = std::max(sourceLength, targetLength);
+
+    for (size_t offset = 0; offset < length; offset += UPS_CHUNK_SIZE)
+    {
+        const size_t sourceChunk = offset < sourceLength ? std::min(sourceLength - offset, static_cast<size_t>(UPS_CHUNK_SIZE)) : 0;
+        const size_t targetChunk = offset < targetLength ? std::min(targetLength - offset, static_cast<size_t>(UPS_CHUNK_SIZE)) : 0;
+
+        const u8 *sourceBytes = sourceChunk > 0 ? source + offset : sZeros;
+        const u8 *targetBytes = targetChunk > 0 ? target + offset : sZeros;
+
+        pushChunk(sourceBytes, sourceChunk, targetBytes, targetChunk);
+
+        m_sourceCrc = crc32(sourceBytes, sourceChunk, m_sourceCrc);
+        m_targetCrc = crc32(targetBytes, targetChunk, m_targetCrc);
+        m_sourceSize += sourceChunk;
+        m_targetSize += targetChunk;
+    }
+}
+
+/**
+ * @param output
+ *
+ * @brief Writes the whole patch into output,
+ * once both files have been pushed.
+ *
+ * @details The header holds both sizes, which
+ * is why the records are kept until then.
+ */
+void UPSEncoder::finish(BigEdian *output)
+{
+    std::vector<u8> header(sUPSMagic, sUPSMagic + UPS_MAGIC_LENGTH);
+    u8 bytes[VAR_INT_MAX_LENGTH];
+    u8 footer[UPS_FOOTER_SIZE];
+
+    // A record going on up to the end still gets its end.
+    if (m_isInRecord)
+        m_records.push_back(0);
+
+    m_isInRecord = false;
+
+    header.insert(header.end(), bytes, bytes + encodeNumber(m_sourceSize, bytes));
+    header.insert(header.end(), bytes, bytes + encodeNumber(m_targetSize, bytes));
+
+    encodeLittleU32(m_sourceCrc, footer);
+    encodeLittleU32(m_targetCrc, footer + 4);
+
+    u32 patchCrc = crc32(header.data(), header.size());
+
+    patchCrc = crc32(m_records.data(), m_records.size(), patchCrc);
+    encodeLittleU32(crc32(footer, 8, patchCrc), footer + 8);
+
+    output->writeBytes(header.data(), header.size());
+
+    if (!m_records.empty())
+        output->writeBytes(m_records.data(), m_records.size());
+
+    output->writeBytes(footer, UPS_FOOTER_SIZE);
+}
+
+/**
+ * @brief Returns how many records were made.
+ */
+size_t UPSEncoder::recordCount() const
+{
+    return m_recordCount;
+}
+
+/**
+ * @brief Returns how many differing bytes the records hold.
+ */
+size_t UPSEncoder::byteCount() const
+{
+    return m_byteCount;
+}
+
+/**
+ * @param patch
+ * @param patchSize
+ *
+ * @brief Tells UPS patches apart
+ * from other ones by their header.
+ */
+bool isUPS(const u8 *patch, const size_t patchSize)
+{
+    return patchSize >= UPS_MAGIC_LENGTH && std::memcmp(patch, sUPSMagic, UPS_MAGIC_LENGTH) == 0;
+}
+
+/**
+ * @param source
+ * @param header
+ * @param start
+ * @param end
+ * @param sourceCrc
+ * @param targetCrc
+ *
+ * @brief Checksums [start, end) of both files,
+ * where the patch leaves them the same.
+ */
+static void checksumSame(const u8 *source, const UPSHeader &header, size_t start, const size_t end, u32 *sourceCrc, u32 *targetCrc)
+{
+    while (start < end)
+    {
+        size_t stop = std::min(end, start + UPS_CHUNK_SIZE);
+        const u8 *bytes = padded(source, header.sourceSize, start, &stop);
+
+        if (start < header.sourceSize)
+            *sourceCrc = crc32(bytes, stop - start, *sourceCrc);
+        if (start < header.targetSize)
+            *targetCrc = crc32(bytes, std::min(stop, static_cast<size_t>(header.targetSize)) - start, *targetCrc);
+
+        start = stop;
+    }
+}
+
+/**
+ * @param patch
+ * @param header
+ * @param source
+ * @param onWrite
+ * @param sourceCrc
+ * @param targetCrc
+ * @param summary
+ *
+ * @brief Walks every record, either checksumming
+ * both files or writing the target's bytes.
+ *
+ * @details Without onWrite, every byte of both files
+ * gets checksummed, a chunk at a time while it's in
+ * cache, in the same single pass over the source.
+ * With it, only the records' bytes are read, and
+ * handed to it as long as they're within the target.
+ *
+ * @returns Ok, or why the records don't fit the files.
+ */
+static MidIPS::Status walkRecords(const u8 *patch, const UPSHeader &header, const u8 *source, const std::function<void(size_t, const u8 *, size_t)> &onWrite, u32 *sourceCrc, u32 *targetCrc, UPSSummary *summary)
+{
+    const size_t length = std::max(header.sourceSize, header.targetSize);
+    size_t position = header.recordsStart;
+    size_t offset = 0;
+    u8 bytes[UPS_CHUNK_SIZE];
+
+    summary->recordCount = 0;
+    summary->byteCount = 0;
+
+    while (position < header.recordsEnd)
+    {
+        u64 relative = 0;
+
+        if (!readNumber(patch, header.recordsEnd, &position, &relative))
+        {
+            summary->error = "The patch is cut short.";
+            return MidIPS::Status::Truncated;
+        }
+
+        const u8 *record = patch + position;
+        const u8 *terminator = static_cast<const u8 *>(std::memchr(record, 0, header.recordsEnd - position));
+
+        if (terminator == nullptr)
+        {
+            summary->error = "The patch is cut short.";
+            return MidIPS::Status::Truncated;
+        }
+
+        const size_t recordLength = terminator - record;
+
+        if (relative > length - offset || recordLength > length - offset - relative)
+        {
+            summary->error = "A record goes past the end of the files.";
+            return MidIPS::Status::OffsetOutOfRange;
+        }
+
+        if (!onWrite)
+            checksumSame(source, header, offset, offset + relative, sourceCrc, targetCrc);
+
+        offset += relative;
+
+        for (size_t done = 0; done < recordLength;)
+        {
+            size_t stop = offset + std::min(recordLength - done, static_cast<size_t>(UPS_CHUNK_SIZE));
+            const u8 *sourceBytes = padded(source, header.sourceSize, offset, &stop);
+            const size_t chunk = stop - offset;
+
+            for (size_t k = 0; k < chunk; k++)
+                bytes[k] = sourceBytes[k] ^ record[done + k];
+
+            if (!onWrite)
+            {
+                if (offset < header.sourceSize)
+                    *sourceCrc = crc32(sourceBytes, chunk, *sourceCrc);
+                if (offset < header.targetSize)
+                    *targetCrc = crc32(bytes, std::min(stop, static_cast<size_t>(header.targetSize)) - offset, *targetCrc);
+            }
+            else if (offset < header.targetSize)
+                onWrite(offset, bytes, std::min(stop, static_cast<size_t>(header.targetSize)) - offset);
+
+            offset = stop;
+            done += chunk;
+        }
+
+        // The terminator stands for an equal byte, unless the files are over.
+        if (!onWrite && offset < length)
+            checksumSame(source, header, offset, offset + 1, sourceCrc, targetCrc);
+
+        offset = std::min(offset + 1, length);
+        position += recordLength + 1;
+        summary->recordCount++;
+        summary->byteCount += recordLength;
+    }
+
+    if (!onWrite)
+        checksumSame(source, header, offset, length, sourceCrc, targetCrc);
+
+    return MidIPS::Status::Ok;
+}
+
+/**
+ * @param patch
+ * @param patchSize
+ * @param source
+ * @param sourceSize
+ * @param onWrite
+ * @param summary
+ *
+ * @brief Applies the UPS patch on source, handing
+ * the target's bytes that differ to onWrite.
+ *
+ * @details The patch is checked against its own CRC-32
+ * first. Then a single pass over the source checksums
+ * it along with the target it would give, and only if
+ * both match the patch's, a second pass over the records
+ * alone writes them, so a patch never gets half applied.
+ * The target is the source resized to summary's targetSize,
+ * with onWrite's bytes over it. Without onWrite, the patch
+ * is only checked.
+ */
+MidIPS::Status applyUPS(const u8 *patch, const size_t patchSize, const u8 *source, const size_t sourceSize, const std::function<void(size_t offset, const u8 *bytes, size_t length)> &onWrite, UPSSummary *summary)
+{
+    UPSHeader header;
+    size_t position = UPS_MAGIC_LENGTH;
+    u32 sourceCrc = 0;
+    u32 targetCrc = 0;
+
+    if (!isUPS(patch, patchSize) || patchSize < UPS_MAGIC_LENGTH + UPS_FOOTER_SIZE)
+    {
+        summary->error = "The passed file is not a valid UPS patch.";
+        return MidIPS::Status::InvalidHeader;
+    }
+
+    header.recordsEnd = patchSize - UPS_FOOTER_SIZE;
+    header.sourceCrc = readLittleU32(patch + header.recordsEnd);
+    header.targetCrc = readLittleU32(patch + header.recordsEnd + 4);
+
+    if (crc32(patch, patchSize - 4) != readLittleU32(patch + patchSize - 4))
+    {
+        summary->error = "The patch is corrupted, its checksum doesn't match.";
+        return MidIPS::Status::ChecksumMismatch;
+    }
+    if (!readNumber(patch, header.recordsEnd, &position, &header.sourceSize) || !readNumber(patch, header.recordsEnd, &position, &header.targetSize))
+    {
+        summary->error = "The patch's header is cut short.";
+        return MidIPS::Status::Truncated;
+    }
+    if (header.sourceSize != sourceSize)
+    {
+        summary->error = "The patch wasn't made for this file.";
+        return MidIPS::Status::ChecksumMismatch;
+    }
+
+    header.recordsStart = position;
+    summary->targetSize = header.targetSize;
+
+    const MidIPS::Status checked = walkRecords(patch, header, source, nullptr, &sourceCrc, &targetCrc, summary);
+
+    if (checked != MidIPS::Status::Ok)
+        return checked;
+    if (sourceCrc != header.sourceCrc)
+    {
+        summary->error = "The patch wasn't made for this file.";
+        return MidIPS::Status::ChecksumMismatch;
+    }
+    if (targetCrc != header.targetCrc)
+    {
+        summary->error = "The patched file's checksum doesn't match the patch's.";
+        return MidIPS::Status::ChecksumMismatch;
+    }
+    if (!onWrite)
+        return MidIPS::Status::Ok;
+
+    return walkRecords(patch, header, source, onWrite, &sourceCrc, &targetCrc, summary);
+}
@@ -0,0 +1,95 @@
+#include "VarInt.hpp"
+
+/**
+ * @param bytes
+ * @param end
+ * @param position
+ * @param number
+ *
+ * @brief Reads one of BPS' and UPS' variable-length numbers,
+ * 7 bits per byte, the last byte having the top bit set.
+ *
+ * @details Every byte past the first also adds what the
+ * number would be with one byte less, so that each number
+ * has a single encoding.
+ *
+ * @returns Whether it fits before end.
+ */
+bool readNumber(const u8 *bytes, const size_t end, size_t *position, u64 *number)
+{
+    u64 shift = 1;
+
+    *number = 0;
+
+    for (size_t i = 0; *position < end && i < VAR_INT_MAX_LENGTH; i++)
+    {
+        const u8 byte = bytes[(*position)++];
+
+        *number += (byte & 0x7F) * shift;
+
+        if (byte & 0x80)
+            return true;
+
+        shift <<= 7;
+        *number += shift;
+    }
+
+    return false;
+}
+
+/**
+ * @param number
+ * @param bytes
+ *
+ * @brief Encodes number into bytes, which
+ * holds at least VAR_INT_MAX_LENGTH of them.
+ *
+ * @returns How many bytes it took.
+ */
+size_t encodeNumber(u64 number, u8 *bytes)
+{
+    size_t length = 0;
+
+    while (true)
+    {
+        const u8 bits = number & 0x7F;
+
+        number >>= 7;
+
+        if (number == 0)
+        {
+            bytes[length++] = 0x80 | bits;
+            break;
+        }
+
+        bytes[length++] = bits;
+        number--;
+    }
+
+    return length;
+}
+
+/**
+ * @param bytes
+ *
+ * @brief Reads a little-endian u32,
+ * the patches' checksums being so.
+ */
+u32 readLittleU32(const u8 *bytes)
+{
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<u32>(bytes[3]) << 24);
+}
+
+/**
+ * @param value
+ * @param bytes
+ *
+ * @brief Encodes value into 4 little-endian bytes.
+ */
+void encodeLittleU32(const u32 value, u8 *bytes)
+{
+    bytes[0] = static_cast<u8>(value);
+    bytes[1] = static_cast<u8>(value >> 8);
+    bytes[2] = static_cast<u8>(value >> 16);
+    bytes[3] = static_cast<u8>(value >> 24);
+}
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <thread>
+#include "WorkPool.hpp"
+
+/**
+ * @param workerCount
+ *
+ * @brief Constructor, workerCount being how
+ * many threads run the jobs at most.
+ */
+WorkPool::WorkPool(const size_t workerCount) : m_workerCount(std::max(static_cast<size_t>(1), workerCount)), m_queues(m_workerCount)
+{
+}
+
+/**
+ * @param worker
+ * @param job
+ *
+ * @brief Takes the next job of worker's own queue,
+ * or steals the last one of another queue.
+ *
+ * @returns Whether there was a job left at all.
+ */
+bool WorkPool::take(const size_t worker, size_t *job)
+{
+    for (size_t i = 0; i < m_workerCount; i++)
+    {
+        Queue &queue = m_queues[(worker + i) % m_workerCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.jobs.empty())
+            continue;
+
+        // Its owner works from the front, the thieves from the back.
+        if (i == 0)
+        {
+            *job = queue.jobs.front();
+            queue.jobs.pop_front();
+        }
+        else
+        {
+            *job = queue.jobs.back();
+            queue.jobs.pop_back();
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @param jobCount
+ * @param work
+ *
+ * @brief Calls work for every job, from 0
+ * to jobCount, on the pool's threads.
+ *
+ * @details Each thread starts with its own consecutive
+ * share of the jobs, and once it's done steals from the
+ * others, so a few long jobs don't leave the other threads
+ * idle. It returns once every job is done.
+ */
+void WorkPool::run(const size_t jobCount, const std::function<void(size_t job)> &work)
+{
+    const size_t workerCount = std::min(m_workerCount, jobCount);
+    std::vector<std::thread> workers;
+
+    for (size_t i = 0; i < jobCount; i++)
+        m_queues[i * workerCount / jobCount].jobs.push_back(i);
+
+    for (size_t i = 0; i < workerCount; i++)
+    {
+        workers.push_back(std::thread([this, i, &work]()
+                                      {
+                                          size_t job = 0;
+
+                                          while (take(i, &job))
+                                              work(job);
+                                      }));
+    }
+
+    for (size_t i = 0; i < workerCount; i++)
+        workers[i].join();
+}
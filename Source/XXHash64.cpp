@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <cstring>
+#include "XXHash64.hpp"
+
+//! @brief xxHash64's primes.
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+/**
+ * @param value
+ * @param count
+ *
+ * @brief Rotates value count bits to the left.
+ */
+static u64 rotateLeft(const u64 value, const u32 count)
+{
+    return (value << count) | (value >> (64 - count));
+}
+
+/**
+ * @param bytes
+ *
+ * @brief Reads a little-endian u64,
+ * whatever the machine's order.
+ */
+static u64 loadLittle64(const u8 *bytes)
+{
+    u64 retVal = 0;
+
+    for (size_t i = 8; i-- > 0;)
+        retVal = (retVal << 8) | bytes[i];
+
+    return retVal;
+}
+
+/**
+ * @param bytes
+ *
+ * @brief Reads a little-endian u32.
+ */
+static u64 loadLittle32(const u8 *bytes)
+{
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<u64>(bytes[3]) << 24);
+}
+
+/**
+ * @param lane
+ * @param input
+ *
+ * @brief Mixes 8 bytes of input into a lane.
+ */
+static u64 mixLane(u64 lane, const u64 input)
+{
+    lane += input * PRIME64_2;
+    return rotateLeft(lane, 31) * PRIME64_1;
+}
+
+/**
+ * @param hash
+ * @param lane
+ *
+ * @brief Folds a lane into the final hash.
+ */
+static u64 mergeLane(u64 hash, const u64 lane)
+{
+    hash ^= mixLane(0, lane);
+    return hash * PRIME64_1 + PRIME64_4;
+}
+
+/**
+ * @param seed
+ *
+ * @brief Constructor, hashing nothing so far.
+ */
+XXHash64::XXHash64(const u64 seed) : m_stripeLength(0), m_totalLength(0)
+{
+    m_lanes[0] = seed + PRIME64_1 + PRIME64_2;
+    m_lanes[1] = seed + PRIME64_2;
+    m_lanes[2] = seed;
+    m_lanes[3] = seed - PRIME64_1;
+}
+
+/**
+ * @param stripe
+ *
+ * @brief Mixes a whole stripe into the lanes.
+ */
+void XXHash64::consume(const u8 *stripe)
+{
+    for (size_t i = 0; i < 4; i++)
+        m_lanes[i] = mixLane(m_lanes[i], loadLittle64(stripe + i * 8));
+}
+
+/**
+ * @param bytes
+ * @param length
+ *
+ * @brief Hashes the next bytes.
+ *
+ * @details Whole stripes are mixed straight from bytes,
+ * only what's left of them being kept for later.
+ */
+void XXHash64::update(const u8 *bytes, size_t length)
+{
+    m_totalLength += length;
+
+    if (m_stripeLength > 0)
+    {
+        const size_t taken = std::min(length, static_cast<size_t>(XXHASH64_STRIPE_SIZE) - m_stripeLength);
+
+        std::memcpy(m_stripe + m_stripeLength, bytes, taken);
+        m_stripeLength += taken;
+        bytes += taken;
+        length -= taken;
+
+        if (m_stripeLength < XXHASH64_STRIPE_SIZE)
+            return;
+
+        consume(m_stripe);
+        m_stripeLength = 0;
+    }
+
+    for (; length >= XXHASH64_STRIPE_SIZE; bytes += XXHASH64_STRIPE_SIZE, length -= XXHASH64_STRIPE_SIZE)
+        consume(bytes);
+
+    if (length > 0)
+        std::memcpy(m_stripe, bytes, length);
+
+    m_stripeLength = length;
+}
+
+/**
+ * @brief Returns the hash of every byte so far,
+ * more bytes may still be hashed afterwards.
+ */
+u64 XXHash64::digest() const
+{
+    u64 retVal = 0;
+    size_t i = 0;
+
+    if (m_totalLength >= XXHASH64_STRIPE_SIZE)
+    {
+        retVal = rotateLeft(m_lanes[0], 1) + rotateLeft(m_lanes[1], 7) + rotateLeft(m_lanes[2], 12) + rotateLeft(m_lanes[3], 18);
+
+        for (size_t lane = 0; lane < 4; lane++)
+            retVal = mergeLane(retVal, m_lanes[lane]);
+    }
+    else
+    {
+        // The seed, as the lanes were never mixed.
+        retVal = m_lanes[2] + PRIME64_5;
+    }
+
+    retVal += m_totalLength;
+
+    for (; i + 8 <= m_stripeLength; i += 8)
+        retVal = rotateLeft(retVal ^ mixLane(0, loadLittle64(m_stripe + i)), 27) * PRIME64_1 + PRIME64_4;
+    for (; i + 4 <= m_stripeLength; i += 4)
+        retVal = rotateLeft(retVal ^ (loadLittle32(m_stripe + i) * PRIME64_1), 23) * PRIME64_2 + PRIME64_3;
+    for (; i < m_stripeLength; i++)
+        retVal = rotateLeft(retVal ^ (m_stripe[i] * PRIME64_5), 11) * PRIME64_1;
+
+    retVal ^= retVal >> 33;
+    retVal *= PRIME64_2;
+    retVal ^= retVal >> 29;
+    retVal *= PRIME64_3;
+    retVal ^= retVal >> 32;
+
+    return retVal;
+}